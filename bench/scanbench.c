@@ -0,0 +1,180 @@
+// memmem is a GNU extension
+#define _GNU_SOURCE
+#include "../include/least.h"
+
+// Line splitting and substring search throughput of each scanner over
+// synthetic log text or a mapped file, exiting non-zero if a substring
+// scanner finds the wrong number of hits:
+// scanbench [-f FILE] [-p NEEDLE] [SIZE_MB] [AVG_LINE] [ROUNDS]
+double bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, & now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+// Random printable lines, every BENCH_NEEDLE_EVERY-th of them starting with
+// needle so the substring scanners have hits to find; planted counts them
+#define BENCH_NEEDLE_EVERY 64
+char * bench_synthesize(size_t size, int avg_line, const char * needle, long * planted) {
+  char * data = malloc(size);
+  if (!data) return NULL;
+  size_t length = strlen(needle);
+  unsigned int seed = 12345;
+  size_t pos = 0;
+  long lines = 0;
+  * planted = 0;
+  while (pos < size) {
+    seed = seed * 1103515245 + 12345;
+    size_t len = 1 + (seed >> 8) % (2 * avg_line);
+    size_t i = 0;
+    if (lines++ % BENCH_NEEDLE_EVERY == 0 && pos + length < size) {
+      memcpy(data + pos, needle, length);
+      pos += length;
+      i = length;
+      ( * planted)++;
+    }
+    for (; i < len && pos < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[pos++] = ' ' + (seed >> 16) % 95;
+    }
+    if (pos < size) data[pos++] = '\n';
+  }
+  return data;
+}
+long bench_count(ScanFunc scan, const char * data, size_t size, int delims) {
+  const char * ends[SCAN_BATCH];
+  const char * pos = data;
+  const char * end = data + size;
+  long lines = 0;
+  while (pos < end) {
+    int found = scan(pos, end, delims, ends, SCAN_BATCH);
+    if (found == 0) break;
+    lines += found;
+    pos = ends[found - 1] + 1;
+  }
+  return lines;
+}
+long bench_memchr(const char * data, size_t size) {
+  const char * pos = data;
+  const char * end = data + size;
+  long lines = 0;
+  while ((pos = memchr(pos, '\n', end - pos))) {
+    lines++;
+    pos++;
+  }
+  return lines;
+}
+long bench_find(FindFunc find, const char * data, size_t size, const char * needle) {
+  size_t length = strlen(needle);
+  const char * pos = data;
+  const char * end = data + size;
+  long found = 0;
+  while ((pos = find(pos, end, needle, length))) {
+    found++;
+    pos += length;
+  }
+  return found;
+}
+long bench_regex(const char * data, size_t size, const char * needle) {
+  regex_t regex;
+  if (regcomp( & regex, needle, REG_EXTENDED | REG_NEWLINE)) return -1;
+  regmatch_t pmatch[1];
+  long found = 0;
+  size_t offset = 0;
+  for (;;) {
+    pmatch[0].rm_so = offset;
+    pmatch[0].rm_eo = size;
+    if (regexec( & regex, data, 1, pmatch, REG_STARTEND) != 0) break;
+    found++;
+    offset = pmatch[0].rm_eo;
+  }
+  regfree( & regex);
+  return found;
+}
+int main(int argc, char * argv[]) {
+  const char * file = NULL;
+  const char * needle = "took=999ms";
+  int arg = 1;
+  while (argc > arg + 1 && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "-f") == 0) file = argv[arg + 1];
+    else if (strcmp(argv[arg], "-p") == 0 && strlen(argv[arg + 1]) >= 2) needle = argv[arg + 1];
+    else break;
+    arg += 2;
+  }
+  size_t size = (size_t)(argc > arg ? atol(argv[arg]) : 1024) << 20;
+  int avg_line = argc > arg + 1 ? atoi(argv[arg + 1]) : 80;
+  int rounds = argc > arg + 2 ? atoi(argv[arg + 2]) : 5;
+  if (avg_line < 1) avg_line = 1;
+  if (rounds < 1) rounds = 1;
+  char * data;
+  long planted = 0;
+  if (file) {
+    int fd = open(file, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, & st) < 0 || st.st_size == 0) {
+      fprintf(stderr, "Cannot map %s\n", file);
+      return 1;
+    }
+    size = st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "Cannot map %s\n", file);
+      return 1;
+    }
+  } else {
+    data = bench_synthesize(size, avg_line, needle, & planted);
+    if (!data) {
+      fprintf(stderr, "Cannot allocate %zu bytes\n", size);
+      return 1;
+    }
+  }
+  printf("%s: %.1f MB, best of %d rounds\n", file ? file : "synthetic", size / 1048576.0, rounds);
+  const char * names[] = {"scalar", "sse2", "avx2"};
+  for (int n = 0; n < 4; n++) {
+    for (int delims = SCAN_NEWLINE; delims <= (SCAN_NEWLINE | SCAN_NUL); delims += SCAN_NUL) {
+      ScanFunc scan = n < 3 ? scan_select(names[n]) : NULL;
+      if (n < 3 && !scan) {
+        printf("%-8s unsupported on this CPU\n", names[n]);
+        break;
+      }
+      if (n == 3 && delims != SCAN_NEWLINE) break;
+      double best = 0;
+      long lines = 0;
+      for (int r = 0; r < rounds; r++) {
+        double start = bench_now();
+        lines = scan ? bench_count(scan, data, size, delims) : bench_memchr(data, size);
+        double elapsed = bench_now() - start;
+        if (r == 0 || elapsed < best) best = elapsed;
+      }
+      printf("%-8s %-10s %10ld lines %8.2f GB/s\n", n < 3 ? names[n] : "memchr", delims == SCAN_NEWLINE ? "\\n" : "\\n and \\0", lines, size / best / 1e9);
+    }
+  }
+  // Random text could hold the needle by chance too, so the expected count
+  // comes from memmem, and for synthetic data must cover what was planted
+  long expected = 0;
+  for (const char * pos = data; (pos = memmem(pos, data + size - pos, needle, strlen(needle))); pos += strlen(needle)) expected++;
+  int failed = !file && expected < planted;
+  if (file) printf("searching for \"%s\", %ld hits expected\n", needle, expected);
+  else printf("searching for \"%s\", %ld hits expected, %ld planted\n", needle, expected, planted);
+  for (int n = 0; n < 4; n++) {
+    FindFunc find = n < 3 ? find_select(names[n]) : NULL;
+    if (n < 3 && !find) {
+      printf("%-8s unsupported on this CPU\n", names[n]);
+      continue;
+    }
+    double best = 0;
+    long found = 0;
+    for (int r = 0; r < rounds; r++) {
+      double start = bench_now();
+      found = find ? bench_find(find, data, size, needle) : bench_regex(data, size, needle);
+      double elapsed = bench_now() - start;
+      if (r == 0 || elapsed < best) best = elapsed;
+    }
+    // A pattern with metacharacters is not a literal to regexec
+    int checked = n < 3 || strpbrk(needle, ".[]()*+?{}|^$\\") == NULL;
+    int wrong = checked && found != expected;
+    printf("%-8s %10ld hits  %8.2f GB/s%s\n", n < 3 ? names[n] : "regexec", found, size / best / 1e9, wrong ? "  WRONG" : "");
+    if (wrong) failed = 1;
+  }
+  return failed;
+}
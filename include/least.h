@@ -1,4 +1,3 @@
-
 #ifndef LEAST_H
 #define LEAST_H
 
@@ -14,46 +13,280 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <wchar.h>
+#include <locale.h>
 #include <regex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+#include <stdint.h>
 
-#define MAX_LINES 100000
 #define MAX_LINE_LENGTH 2048
 #define COMMAND_BUFFER_SIZE 256
 #define SEARCH_BUFFER_SIZE 256
 #define MAX_BUFFERS 100
 #define TAB_SIZE 8
+#define LINE_CHUNK_SHIFT 6
+#define LINE_TABLE_CHUNKS 26
+#define INDEX_BATCH_LINES 256
+#define ARENA_ALIGN 8
+#define ARENA_MIN_BLOCK 4096
+#define ARENA_MAX_BLOCK (8 << 20)
+#define INDEX_PRIME_LINES 512
+#define WRAP_JOB_LINES 16384
+#define WRAP_BUSY -1
+#define POOL_MAX_THREADS 32
+#define EVENT_MAX_WATCHES 16
+#define FOLLOW_READ_MAX (4 << 20)
+#define FOLLOW_POLL_MS 500
+#define STREAM_CHUNK (1 << 20)
+#define REDRAW_INTERVAL_MS 40
+#define SCAN_NEWLINE 1
+#define SCAN_NUL 2
+#define SCAN_BATCH 256
+#define SEARCH_SHARD_LINES 32768
+#define SEARCH_INVALID -2
+#define SEARCH_PENDING -3
+#define SEARCH_NO_MEMORY -4
+#define TRIGRAM_BLOCK 65536
+#define TRIGRAM_BUCKETS 16384
+#define TRIGRAM_VERSION 1
+// Highlighter state between characters, see lexer.c. Only LEX_COMMENT,
+// LEX_STRING and LEX_CHAR are carried from one line to the next.
+#define LEX_COMMENT 1
+#define LEX_STRING 2
+#define LEX_CHAR 4
+#define LEX_ESCAPE 8
+#define LEX_LINE_COMMENT 16
+#define LEX_OPENING 32
+#define LEX_CLOSING 64
+#define LEX_CLASS_CODE 0
+#define LEX_CLASS_COMMENT 1
+#define LEX_CLASS_STRING 2
+#define LEX_CHUNK_LINES 4096
+#define LEX_START_STATES 4
+#define RENDER_CACHE_LINES 256
+#define DRAW_BATCH 256
+
+typedef struct ArenaBlock {
+  struct ArenaBlock * next;
+  size_t size;
+  size_t used;
+  char data[];
+} ArenaBlock;
+
+// Bump allocator; everything allocated from it is released at once
+typedef struct {
+  ArenaBlock * head;
+} Arena;
 
 typedef struct {
   int start;
   int end;
 } SearchMatch;
 
+// Search matches in compressed sparse row form: lines[k] ascending, and its
+// matches are matches[offsets[k], offsets[k + 1])
 typedef struct {
+  int * lines;
+  int * offsets;
   SearchMatch * matches;
-  int count;
-  int capacity;
-} LineMatches;
+  int line_count;
+  int line_capacity;
+  int match_count;
+  int match_capacity;
+} MatchTable;
 
 typedef struct {
-  char * content;
+  const char * content;
   int length;
-  int allocated;
+  int allocated; // 0 when content points into the buffer's file mapping
   int * wrap_points;
   int wrap_count;
   int wrapped_lines;
-  LineMatches matches;
+  int wrap_gen; // wraps are only valid while this matches Buffer.wrap_gen
+  unsigned char lex_state; // highlighter state at the start of the line
+  int width; // display width of the whole line, -1 until measured
 } Line;
 
+// Chunk k holds (1 << LINE_CHUNK_SHIFT) << k lines, so chunks never move
+// and LINE_TABLE_CHUNKS of them cover every int line index.
+typedef struct {
+  Line * chunks[LINE_TABLE_CHUNKS];
+  int capacity;
+} LineTable;
+
+// A range of lines wrapped on the thread pool. Wrap points go to the job's
+// own arena and exact heights to heights[] until the main thread folds them
+// into the buffer with buffer_collect_wraps().
+typedef struct WrapJob {
+  LineTable * lines;
+  int first;
+  int last;
+  int gen;
+  int width;
+  int * heights;
+  Arena arena;
+  int done;
+  int cancel;
+  struct WrapJob * next;
+} WrapJob;
+
+// A chunk of LEX_CHUNK_LINES lines lexed on the thread pool once from each
+// state a line can start in, so it need not wait for the chunks before it.
+// The main thread chains the results with buffer_collect_lex().
+typedef struct {
+  LineTable * lines;
+  int first;
+  int last;
+  unsigned char ends[LEX_START_STATES]; // state after the chunk, by starting state
+  int done;
+  int cancel;
+} LexJob;
+
+// A range of lines searched on the thread pool with its own compiled copy of
+// the pattern. Its matches are shown once buffer_collect_search() has seen it
+// finish, and move into the search's index when the last shard does.
+typedef struct {
+  LineTable * lines;
+  const char * pattern;
+  size_t literal; // length of a pattern without metacharacters, else 0
+  const int * subset; // lines to scan by position, NULL for every line
+  int first; // positions [first, last)
+  int last;
+  MatchTable found;
+  int done;
+  int merged;
+  struct Search * search; // owner, NULL for lines scanned in place
+} SearchShard;
+
+typedef struct Search {
+  char * pattern;
+  size_t literal; // length of a pattern without metacharacters, else 0
+  regex_t regex; // main thread copy, for lines appended later
+  int direction;
+  int from; // line the search started at
+  int jumped; // match :m, n or p last moved the view to, -1 if none
+  int jumped_line; // the line holding it
+  int count; // lines the search has covered, growing while they are indexed
+  int * subset; // lines an earlier search narrowed this one to, or NULL
+  SearchShard ** shards; // nearest to the starting line first
+  int shard_count;
+  int shard_capacity;
+  int around; // first shard past where the search wraps around the buffer
+  int merged;
+  // Every match once all shards are merged; until then only those on
+  // appended lines
+  MatchTable index;
+  int indexed;
+  int cancel;
+  int refs; // the buffer's and one per shard still running; the last frees it
+} Search;
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t progress;
+  LineTable * lines;
+  const char * data;
+  size_t size;
+  size_t offset; // bytes indexed so far, published with indexed
+  int indexed;
+  int done;
+  int cancel;
+} LineIndexer;
+
+// Which TRIGRAM_BLOCK byte blocks of a mapped file hold each hashed trigram:
+// one bitmap over the blocks per bucket, so the blocks that can contain a
+// string are the AND of its trigrams' bitmaps. Loaded from the cache or built
+// on a thread of its own, and only read once done is set.
+typedef struct {
+  pthread_t thread;
+  const char * data;
+  size_t size;
+  struct stat st; // the file the cache entry must match
+  char * cache_path; // NULL when there is nowhere to keep it
+  uint64_t * bits; // TRIGRAM_BUCKETS rows of words each
+  int blocks;
+  int words;
+  int done;
+  int cancel;
+} TrigramIndex;
+
+// Bytes [start, end) of a line drawn with attr
 typedef struct {
-  Line * lines;
+  int start;
+  int end;
+  attr_t attr;
+} CellRun;
+
+// A line's highlighted runs, built as far as it has been drawn and kept
+// until the line's text, starting lexer state or search matches change
+typedef struct {
+  CellRun * runs;
   int count;
   int capacity;
+  int line; // -1 for an empty slot
+  int length;
+  int start_state;
+  unsigned int match_gen;
+  int built; // runs cover bytes [0, built)
+  int state; // lexer state at built
+  int match_cursor; // first match that may end after built
+} RenderLine;
+
+typedef struct {
+  LineTable * lines;
+  int count;
   char * filename;
+  char * map;
+  size_t map_size;
+  int map_slot; // its entry in the SIGBUS handler's table, -1 if none
+  Arena text_arena; // copied line content for pipes and command output
+  char * tail; // text after the last newline, shown as a provisional last line
+  size_t tail_length;
+  size_t tail_capacity;
+  Arena wrap_arena; // wrap points, reset when the buffer is rewrapped
   int current_line;
   int screen_line;
   int top_line;
   int total_wrapped_lines;
+  int * wrap_tree; // Fenwick tree of wrapped_lines, see wraptree.c
+  int tree_count;
+  int tree_capacity;
+  int wrap_width;
+  int wrap_gen; // bumped on every rewrap, 0 until the buffer is first wrapped
+  int refine_pos; // next line to hand to the wrap workers
+  WrapJob * wrap_jobs;
   int show_line_numbers;
+  int chop_lines; // one row per line, scrolled sideways instead of wrapped
+  int left_column; // columns scrolled off the left edge while chopping
+  LineIndexer * indexer; // non-NULL while lines are still being indexed
+  Search * search; // where the stored matches came from, NULL if none
+  TrigramIndex * trigrams; // NULL unless the file is mapped and -T was given
+  off_t file_offset; // bytes of the file loaded so far, -1 if not a regular file
+  int follow_fd; // open on the file while following, -1 otherwise
+  int follow_watch; // inotify descriptor, -1 when the file is polled instead
+  int follow_pending; // the file may have grown since the last read
+  int pin_end; // keep the view on the last line until indexing finishes
+  int streaming; // stdin is still being read into this buffer
+  int dirty; // lines were appended since the last redraw
+  int dropped; // input was lost for lack of memory
+  // Lines [lex_first, lex_valid) have a known lex_state, lexed on demand
+  // from the checkpoint at the start of lex_first's chunk
+  int lex_first;
+  int lex_valid;
+  unsigned char * lex_marks; // state at the first line of chunks [0, lex_chunks]
+  int lex_chunks;
+  int lex_marks_capacity;
+  LexJob ** lex_jobs; // in flight, for the chunks from lex_chunks on
+  int lex_job_count;
+  int lex_job_capacity;
+  RenderLine * render_cache; // RENDER_CACHE_LINES slots by line index, or NULL
+  unsigned int match_gen; // bumped whenever a line's search matches may change
 } Buffer;
 
 typedef struct {
@@ -65,26 +298,167 @@ typedef struct {
   int command_mode;
   int search_mode;
   int last_search_direction;
+  int search_origin; // top line when '/' was pressed
+  int search_origin_screen;
+  int search_pending; // the incremental search has not jumped yet
+  // What the text rows showed after the last display_lines, so the next one
+  // only draws rows that changed
+  LineTable * drawn_lines; // NULL when every row must be drawn
+  int drawn_line;
+  int drawn_wrap;
+  int drawn_rows;
+  int drawn_wrap_gen;
+  unsigned int drawn_match_gen;
+  int drawn_numbers;
+  int drawn_left;
+  int chop_lines; // buffers start chopped, from -S
 } Editor;
 
+typedef int( * ScanFunc)(const char * pos, const char * end, int delims, const char ** ends, int max);
+typedef const char * ( * FindFunc)(const char * pos, const char * end, const char * needle, size_t size);
+typedef int( * PrintableFunc)(const char * pos, const char * end);
+
 struct SyntaxPattern {
   char * pattern;
   int color_pair;
 };
 
+static inline Line * line_table_get(const LineTable * table, int index) {
+  unsigned int slot = (unsigned int) index + (1u << LINE_CHUNK_SHIFT);
+  int chunk = 31 - __builtin_clz(slot) - LINE_CHUNK_SHIFT;
+  return & table -> chunks[chunk][slot - ((1u << LINE_CHUNK_SHIFT) << chunk)];
+}
+static inline Line * buffer_line(const Buffer * buf, int index) {
+  return line_table_get(buf -> lines, index);
+}
+// Lines the wrap and search workers may read: all but a last line that is
+// still waiting for its newline in the tail
+static inline int buffer_settled(const Buffer * buf) {
+  return buf -> tail_length > 0 ? buf -> count - 1 : buf -> count;
+}
+
 /* Changed from definition to declaration with extern */
 
+extern volatile sig_atomic_t resize_pending;
 void handle_resize(int sig);
+void apply_resize(Editor * ed);
 void draw_status_bar(Editor * ed);
 void display_lines(Editor * ed);
-void display_wrapped_line(const Line * line, int start, int end, int y, int x);
+void display_wrapped_line(const Line * line, const RenderLine * render, int start, int end, int y, int x);
+int screen_char_width(const char * pos, const char * end, int x, int * bytes);
+void chop_columns(const Line * line, int left, int * start, int * end, int * x);
 void screen_to_file_position(Editor * ed, int screen_line, int * file_line, int * wrap_index);
 int get_display_width(const char * str, int len);
 Buffer * current_buffer(Editor * ed);
 void recalculate_wraps(Editor * ed);
+int keyword_match(const char * pos, const char * end, int * length);
+int lex_char(const char * text, int pos, int length, int * state);
+int lex_scan(const char * text, int start, int end, int length, int state);
+int lex_line_end(int state);
+int buffer_lex_state(Buffer * buf, int index);
+void buffer_lex_changed(Buffer * buf, int index);
+void buffer_schedule_lex(Buffer * buf);
+void buffer_collect_lex(Buffer * buf);
+void buffer_cancel_lex(Buffer * buf);
+void highlight_syntax(const Line * line, RenderLine * render, const SearchMatch * matches, int match_count, int limit);
+void render_add(RenderLine * render, const SearchMatch * matches, int match_count, int start, int end, attr_t attr);
+const RenderLine * buffer_line_runs(Buffer * buf, int index, int limit);
+void render_cache_free(Buffer * buf);
 void editor_destroy(Editor * ed);
 Buffer * editor_new_buffer(Editor * ed);
-void calculate_line_wraps(Line * line, int screen_width);
+void calculate_line_wraps(Line * line, int screen_width, Arena * arena);
+void * arena_alloc(Arena * arena, size_t size);
+char * arena_strndup(Arena * arena, const char * str, size_t len);
+void arena_reset(Arena * arena);
+void arena_splice(Arena * dst, Arena * src);
+Line * line_table_slot(LineTable * table, int index);
+void line_table_free(LineTable * table);
+int buffer_text_width(const Buffer * buf);
+int line_height(const Buffer * buf, const Line * line);
+void buffer_rewrap(Buffer * buf, int width);
+void buffer_set_chop(Buffer * buf, int chop);
+int buffer_view_width(Buffer * buf);
+int buffer_wrap_line(Buffer * buf, int index);
+void buffer_ensure_wrapped(Buffer * buf, int first, int last);
+int line_claim_wrap(Line * line, int gen);
+void buffer_schedule_wraps(Buffer * buf);
+int buffer_collect_wraps(Buffer * buf);
+void buffer_cancel_wraps(Buffer * buf);
+void buffer_finish_wraps(Buffer * buf);
+int buffer_at_end(Buffer * buf);
+void buffer_scroll_to_end(Buffer * buf);
+int line_regexec(const regex_t * regex, const Line * line, int offset, regmatch_t * pmatch);
+int buffer_search_start(Buffer * buf, const char * pattern, int direction, int from);
+int buffer_search_nearest(Buffer * buf, int wait);
+int buffer_search(Buffer * buf, const char * pattern, int direction);
+int buffer_search_next(Buffer * buf, const char * pattern, int direction);
+int buffer_collect_search(Buffer * buf);
+void buffer_search_extend(Buffer * buf);
+const SearchMatch * buffer_line_matches(const Buffer * buf, int line, int * count);
+void search_release(Search * search);
+void buffer_cancel_search(Buffer * buf);
+void search_wait_orphans(void);
+void buffer_finish_search(Buffer * buf);
+void buffer_search_appended(Buffer * buf, int first);
+int buffer_match_count(const Buffer * buf);
+int buffer_match_current(Buffer * buf);
+int buffer_match_line(Buffer * buf, int n);
+int buffer_keep_tail(Buffer * buf, const char * data, size_t size);
+int buffer_flush_tail(Buffer * buf);
+int buffer_append_text(Buffer * buf, const char * data, size_t size);
+int follow_start(Buffer * buf);
+void follow_stop(Buffer * buf);
+int follow_update(Buffer * buf);
+int scan_line_ends(const char * pos, const char * end, int delims, const char ** ends, int max);
+ScanFunc scan_select(const char * name);
+const char * scan_find(const char * pos, const char * end, const char * needle, size_t size);
+FindFunc find_select(const char * name);
+int scan_printable(const char * pos, const char * end);
+PrintableFunc printable_select(const char * name);
+int char_width(const char * pos, const char * end, int * bytes);
+int line_display_width(const Line * line);
+int search_regcomp(regex_t * regex, const char * pattern);
+int buffer_read_fd(Buffer * buf, int fd);
+int stream_open(int fd);
+void stream_prime(Editor * ed);
+void stream_detach(Buffer * buf);
+int pool_init(void);
+int pool_threads_count(void);
+int pool_queue(void( * run)(void * arg), void * arg, int urgent);
+int pool_submit(void( * run)(void * arg), void * arg);
+int pool_submit_first(void( * run)(void * arg), void * arg);
+void pool_wait(const int * done);
+void pool_wait_zero(const int * count);
+void pool_shutdown(void);
+int event_init(void);
+void event_signal(void);
+void event_wake(void);
+int event_watch(int fd, void( * callback)(Editor * ed, int fd, void * arg), void * arg);
+void event_unwatch(int fd);
+long event_now_ms(void);
+int event_wait(Editor * ed, int timeout_ms);
+void line_init(Line * line, const char * content, int length, int allocated);
+void buffer_destroy(Buffer * buf);
+void buffer_clear(Buffer * buf);
+int buffer_load(Buffer * buf, int fd);
+int buffer_reload(Buffer * buf, int fd);
+void buffer_unmap(Buffer * buf);
+int buffer_map_stale(const Buffer * buf);
+int indexer_start(Buffer * buf, const char * data, size_t size);
+void indexer_stop(Buffer * buf);
+int trigram_start(Buffer * buf);
+void trigram_stop(Buffer * buf);
+int * trigram_candidates(Buffer * buf, const char * pattern, int * count);
+void buffer_sync(Buffer * buf);
+void buffer_wait_lines(Buffer * buf, int lines);
+void buffer_wait_screen_line(Buffer * buf, int screen_line);
+int buffer_index_progress(const Buffer * buf);
+void wrap_tree_extend(Buffer * buf);
+void wrap_tree_reset(Buffer * buf);
+void wrap_tree_add(Buffer * buf, int line, int delta);
+int wrap_tree_prefix(Buffer * buf, int line);
+int wrap_tree_total(Buffer * buf);
+void wrap_tree_find(Buffer * buf, int screen_line, int * file_line, int * wrap_index);
 Editor * editor_create();
 
 #endif /* LEAST_H */
@@ -0,0 +1,58 @@
+#include "../include/least.h"
+
+void * arena_alloc(Arena * arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  ArenaBlock * block = arena -> head;
+  if (!block || block -> size - block -> used < size) {
+    // Blocks double up to ARENA_MAX_BLOCK; oversized requests get their own block
+    size_t block_size = block ? block -> size * 2 : ARENA_MIN_BLOCK;
+    if (block_size > ARENA_MAX_BLOCK) block_size = ARENA_MAX_BLOCK;
+    if (block_size < size) block_size = size;
+    ArenaBlock * fresh = malloc(sizeof(ArenaBlock) + block_size);
+    if (!fresh) return NULL;
+    fresh -> size = block_size;
+    fresh -> used = 0;
+    if (block && block_size == size) {
+      // Keep bumping from the partially used head block
+      fresh -> next = block -> next;
+      block -> next = fresh;
+      fresh -> used = size;
+      return fresh -> data;
+    }
+    fresh -> next = block;
+    arena -> head = block = fresh;
+  }
+  void * ptr = block -> data + block -> used;
+  block -> used += size;
+  return ptr;
+}
+char * arena_strndup(Arena * arena,
+  const char * str, size_t len) {
+  char * copy = arena_alloc(arena, len + 1);
+  if (!copy) return NULL;
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+void arena_reset(Arena * arena) {
+  ArenaBlock * block = arena -> head;
+  while (block) {
+    ArenaBlock * next = block -> next;
+    free(block);
+    block = next;
+  }
+  arena -> head = NULL;
+}
+void arena_splice(Arena * dst, Arena * src) {
+  if (!src -> head) return;
+  ArenaBlock * tail = src -> head;
+  while (tail -> next) tail = tail -> next;
+  // Keep dst's head block first so its free space is still used
+  if (dst -> head) {
+    tail -> next = dst -> head -> next;
+    dst -> head -> next = src -> head;
+  } else {
+    dst -> head = src -> head;
+  }
+  src -> head = NULL;
+}
@@ -2,25 +2,59 @@
 extern struct SyntaxPattern syntax_patterns[];
 extern Editor * GLOBAL_EDITOR;
 
-void calculate_line_wraps(Line * line, int screen_width) {
-  free(line -> wrap_points);
+Line * line_table_slot(LineTable * table, int index) {
+  if (index < 0) return NULL;
+  while (index >= table -> capacity) {
+    int chunk = 0;
+    while (table -> chunks[chunk]) chunk++;
+    if (chunk >= LINE_TABLE_CHUNKS) return NULL;
+    int size = (1 << LINE_CHUNK_SHIFT) << chunk;
+    table -> chunks[chunk] = malloc(sizeof(Line) * size);
+    if (!table -> chunks[chunk]) return NULL;
+    table -> capacity += size;
+  }
+  return line_table_get(table, index);
+}
+void line_table_free(LineTable * table) {
+  if (!table) return;
+  for (int i = 0; i < LINE_TABLE_CHUNKS && table -> chunks[i]; i++) {
+    free(table -> chunks[i]);
+  }
+  free(table);
+}
+void line_init(Line * line,
+  const char * content, int length, int allocated) {
+  line -> content = content;
+  line -> length = length;
+  line -> allocated = allocated;
+  line -> wrap_points = NULL;
+  line -> wrap_count = 0;
+  line -> wrapped_lines = 1;
+  line -> wrap_gen = 0;
+  line -> width = -1;
+}
+void calculate_line_wraps(Line * line, int screen_width, Arena * arena) {
+  // Wrap points are collected in a per-thread scratch array and copied into
+  // the arena at their exact size
+  static __thread int * scratch = NULL;
+  static __thread int scratch_capacity = 0;
   line -> wrap_points = NULL;
   line -> wrap_count = 0;
   line -> wrapped_lines = 1;
   if (line -> length == 0) return;
-  int max_wraps = (line -> length / (screen_width / 2)) + 1;
-  line -> wrap_points = malloc(sizeof(int) * max_wraps);
-  if (!line -> wrap_points) return;
+  // The width is kept across rewraps, so a line narrower than the screen is
+  // only measured once
+  if (line -> width < 0) line -> width = line_display_width(line);
+  if (line -> width < screen_width) return;
+  const char * end = line -> content + line -> length;
+  int wrap_count = 0;
   int current_width = 0;
   int last_wrap = 0;
   int last_space = -1;
-  for (int i = 0; i < line -> length; i++) {
+  for (int i = 0, bytes = 1; i < line -> length; i += bytes) {
     char c = line -> content[i];
-    if (c == '\t') {
-      current_width += TAB_SIZE - (current_width % TAB_SIZE);
-    } else if (isprint(c)) {
-      current_width++;
-    }
+    // Multibyte characters are stepped over whole, so a wrap never splits one
+    current_width += screen_char_width(line -> content + i, end, current_width, & bytes);
     if (isspace(c)) {
       last_space = i;
     }
@@ -31,13 +65,227 @@ void calculate_line_wraps(Line * line, int screen_width) {
       } else {
         wrap_at = i;
       }
-      line -> wrap_points[line -> wrap_count++] = wrap_at;
+      if (wrap_count >= scratch_capacity) {
+        int new_capacity = scratch_capacity == 0 ? 64 : scratch_capacity * 2;
+        int * new_scratch = realloc(scratch, sizeof(int) * new_capacity);
+        if (!new_scratch) break;
+        scratch = new_scratch;
+        scratch_capacity = new_capacity;
+      }
+      scratch[wrap_count++] = wrap_at;
       last_wrap = wrap_at;
-      current_width = get_display_width(line -> content + wrap_at, i - wrap_at + 1);
+      current_width = get_display_width(line -> content + wrap_at, i + bytes - wrap_at);
       last_space = -1;
-      line -> wrapped_lines++;
     }
   }
+  if (wrap_count == 0) return;
+  line -> wrap_points = arena_alloc(arena, sizeof(int) * wrap_count);
+  if (!line -> wrap_points) return;
+  memcpy(line -> wrap_points, scratch, sizeof(int) * wrap_count);
+  line -> wrap_count = wrap_count;
+  line -> wrapped_lines = wrap_count + 1;
+}
+int buffer_text_width(const Buffer * buf) {
+  int width = COLS - (buf -> show_line_numbers ? 6 : 0);
+  return width > 1 ? width : 1;
+}
+int line_height(const Buffer * buf, const Line * line) {
+  int gen = __atomic_load_n( & line -> wrap_gen, __ATOMIC_ACQUIRE);
+  return gen == buf -> wrap_gen ? line -> wrapped_lines : 1;
+}
+void buffer_rewrap(Buffer * buf, int width) {
+  // Only invalidates: lines count as one row until they are wrapped for the
+  // viewport or by the wrap workers
+  buffer_cancel_wraps(buf);
+  buf -> wrap_width = width;
+  buf -> wrap_gen++;
+  buf -> refine_pos = 0;
+  arena_reset( & buf -> wrap_arena);
+  wrap_tree_reset(buf);
+  // Every line is one row now, so the top line's screen row is its index
+  buf -> screen_line = buf -> current_line;
+}
+// Switches between wrapping lines and chopping them at the right edge. Both
+// directions only invalidate, so the switch costs the same on any buffer.
+void buffer_set_chop(Buffer * buf, int chop) {
+  if (buf -> chop_lines == chop) return;
+  buffer_rewrap(buf, buffer_text_width(buf));
+  buf -> chop_lines = chop;
+  buf -> left_column = 0;
+  if (chop) {
+    // Nothing is wrapped while chopping, so the tree goes too
+    free(buf -> wrap_tree);
+    buf -> wrap_tree = NULL;
+    buf -> tree_capacity = 0;
+  }
+}
+// Display width of the widest line on screen while chopping. Widths are
+// kept on the lines, so scrolling sideways measures each line once.
+int buffer_view_width(Buffer * buf) {
+  int widest = 0;
+  for (int i = buf -> current_line; i < buf -> count && i < buf -> current_line + LINES - 2; i++) {
+    Line * line = buffer_line(buf, i);
+    if (line -> width < 0) line -> width = line_display_width(line);
+    if (line -> width > widest) widest = line -> width;
+  }
+  return widest;
+}
+int buffer_wrap_line(Buffer * buf, int index) {
+  if (buf -> chop_lines) return 0;
+  Line * line = buffer_line(buf, index);
+  if (!line_claim_wrap(line, buf -> wrap_gen)) return 0;
+  wrap_tree_extend(buf);
+  calculate_line_wraps(line, buf -> wrap_width, & buf -> wrap_arena);
+  __atomic_store_n( & line -> wrap_gen, buf -> wrap_gen, __ATOMIC_RELEASE);
+  int delta = line -> wrapped_lines - 1;
+  if (delta) wrap_tree_add(buf, index, delta);
+  return delta;
+}
+void buffer_ensure_wrapped(Buffer * buf, int first, int last) {
+  if (first < 0) first = 0;
+  if (last >= buf -> count) last = buf -> count - 1;
+  for (int i = first; i <= last; i++) buffer_wrap_line(buf, i);
+}
+// Gives the tail's line new text, to be wrapped and lexed again
+void buffer_set_tail_line(Buffer * buf, int index,
+  const char * content, size_t length) {
+  Line * line = buffer_line(buf, index);
+  int height = index < buf -> count ? line_height(buf, line) : 1;
+  buffer_lex_changed(buf, index);
+  line_init(line, content, length, length);
+  if (height > 1) wrap_tree_add(buf, index, 1 - height);
+  if (buf -> refine_pos > index) buf -> refine_pos = index;
+  buf -> dirty = 1;
+}
+// A last line still waiting for its newline is kept in the buffer's tail,
+// which grows by doubling, and shown from there as it arrives. Workers
+// never read it, see buffer_settled(), so it can change without waiting
+// for them. Returns -1, keeping the old tail, when there is no room.
+int buffer_keep_tail(Buffer * buf, const char * data, size_t size) {
+  Line * last = buf -> count > 0 ? buffer_line(buf, buf -> count - 1) : NULL;
+  // A last line loaded without its newline, from the file's end or from
+  // EOF, is reopened and moves into the tail
+  int reopen = buf -> tail_length == 0 && last && last -> length > 0 && last -> content[last -> length - 1] != '\n';
+  size_t kept = reopen ? (size_t) last -> length : buf -> tail_length;
+  if (kept + size > INT_MAX) {
+    buf -> dropped = 1;
+    return -1;
+  }
+  if (buf -> tail_length == 0 && !reopen && !line_table_slot(buf -> lines, buf -> count)) {
+    buf -> dropped = 1;
+    return -1;
+  }
+  if (kept + size > buf -> tail_capacity) {
+    size_t capacity = buf -> tail_capacity ? buf -> tail_capacity : ARENA_MIN_BLOCK;
+    while (capacity < kept + size) capacity *= 2;
+    char * tail = realloc(buf -> tail, capacity);
+    if (!tail) {
+      buf -> dropped = 1;
+      return -1;
+    }
+    buf -> tail = tail;
+    buf -> tail_capacity = capacity;
+  }
+  if (reopen) {
+    // Wrap and search workers may still be reading the line
+    buffer_finish_wraps(buf);
+    buffer_finish_search(buf);
+    search_wait_orphans();
+    memcpy(buf -> tail, last -> content, kept);
+  }
+  memcpy(buf -> tail + kept, data, size);
+  int index = kept > 0 ? buf -> count - 1 : buf -> count;
+  buffer_set_tail_line(buf, index, buf -> tail, kept + size);
+  if (index == buf -> count) buf -> count++;
+  buf -> tail_length = kept + size;
+  return 0;
+}
+// Ends the tail's line where it stands: its text moves to the arena and it
+// becomes a line like the others. Returns the line's index.
+int buffer_flush_tail(Buffer * buf) {
+  if (buf -> tail_length == 0) return buf -> count;
+  int index = buf -> count - 1;
+  char * content = arena_alloc( & buf -> text_arena, buf -> tail_length);
+  if (content) {
+    memcpy(content, buf -> tail, buf -> tail_length);
+    buffer_set_tail_line(buf, index, content, buf -> tail_length);
+  } else {
+    buf -> dropped = 1;
+    buffer_set_tail_line(buf, index, "", 0);
+  }
+  buf -> tail_length = 0;
+  return index;
+}
+// Adds the complete lines in data, which must outlive the buffer; returns
+// the first line that was added or changed
+int buffer_append_text(Buffer * buf,
+  const char * data, size_t size) {
+  const char * pos = data;
+  const char * end = data + size;
+  const char * ends[SCAN_BATCH];
+  int first = buf -> count;
+  while (pos < end) {
+    int found = scan_line_ends(pos, end, SCAN_NEWLINE, ends, SCAN_BATCH);
+    if (found == 0) {
+      if (buffer_keep_tail(buf, pos, end - pos) == 0 && buf -> count - 1 < first) first = buf -> count - 1;
+      break;
+    }
+    int i = 0;
+    Line * last = buf -> count > 0 ? buffer_line(buf, buf -> count - 1) : NULL;
+    if (buf -> tail_length > 0 || (last && last -> length > 0 && last -> content[last -> length - 1] != '\n')) {
+      // The first newline finishes the line that was left open
+      buffer_keep_tail(buf, pos, ends[0] + 1 - pos);
+      int index = buffer_flush_tail(buf);
+      if (index < first) first = index;
+      pos = ends[0] + 1;
+      i = 1;
+    }
+    for (; i < found; i++) {
+      Line * line = line_table_slot(buf -> lines, buf -> count);
+      if (!line) {
+        buf -> dropped = 1;
+        pos = end;
+        break;
+      }
+      line_init(line, pos, ends[i] + 1 - pos, ends[i] + 1 - pos);
+      buf -> count++;
+      pos = ends[i] + 1;
+    }
+  }
+  if (first == buf -> count) return first;
+  buf -> dirty = 1;
+  return first;
+}
+// Reads fd to EOF, for input that cannot be mapped
+int buffer_read_fd(Buffer * buf, int fd) {
+  char * chunk = malloc(STREAM_CHUNK);
+  if (!chunk) return -1;
+  ssize_t got;
+  while ((got = read(fd, chunk, STREAM_CHUNK)) != 0) {
+    if (got < 0 && errno == EINTR) continue;
+    char * text = got > 0 ? arena_alloc( & buf -> text_arena, got) : NULL;
+    if (!text) {
+      free(chunk);
+      return -1;
+    }
+    memcpy(text, chunk, got);
+    buffer_append_text(buf, text, got);
+  }
+  free(chunk);
+  buffer_flush_tail(buf);
+  return 0;
+}
+int buffer_at_end(Buffer * buf) {
+  return wrap_tree_total(buf) - buf -> screen_line <= LINES - 2;
+}
+void buffer_scroll_to_end(Buffer * buf) {
+  int rows = LINES - 2;
+  // Wrap the last page first so the bottom row is exact
+  buffer_ensure_wrapped(buf, buf -> count - rows, buf -> count - 1);
+  int top = wrap_tree_total(buf) - rows;
+  buf -> screen_line = top > 0 ? top : 0;
+  int wrap_index;
+  wrap_tree_find(buf, buf -> screen_line, & buf -> current_line, & wrap_index);
 }
 Buffer * current_buffer(Editor * ed) {
   if (ed -> current_buffer < 0 || ed -> current_buffer >= ed -> num_buffers) {
@@ -48,29 +296,87 @@ Buffer * current_buffer(Editor * ed) {
 void display_lines(Editor * ed) {
   Buffer * buf = current_buffer(ed);
   if (!buf) return;
-  clear();
   int max_display_lines = LINES - 2;
   int displayed_lines = 0;
+  if (buf -> wrap_gen == 0 || buf -> wrap_width != buffer_text_width(buf)) {
+    buffer_rewrap(buf, buffer_text_width(buf));
+  }
   int file_line, wrap_index;
   screen_to_file_position(ed, buf -> screen_line, & file_line, & wrap_index);
-  for (int i = file_line; i < buf -> count && displayed_lines < max_display_lines; i++) {
-    Line * line = & buf -> lines[i];
-    int start = 0;
-    if (buf -> show_line_numbers) {
-      move(displayed_lines, 0);
-      printw("%4d ", i + 1);
+  // Wrap the visible window plus a page above it, then re-anchor on the top
+  // line since heights above it may have changed
+  buffer_ensure_wrapped(buf, file_line - max_display_lines, file_line + max_display_lines);
+  buf -> screen_line = wrap_tree_prefix(buf, file_line) + wrap_index;
+  buf -> current_line = file_line;
+  // Only rows [first_row, last_row) are drawn. When nothing but the view's
+  // position changed, the rows already on screen are scrolled into place,
+  // which the terminal does with its scroll region.
+  int first_row = 0, last_row = max_display_lines;
+  int extra_row = -1;
+  if (ed -> drawn_lines == buf -> lines && !buf -> dirty && ed -> drawn_rows == max_display_lines &&
+    ed -> drawn_wrap_gen == buf -> wrap_gen && ed -> drawn_match_gen == buf -> match_gen &&
+    ed -> drawn_numbers == buf -> show_line_numbers && ed -> drawn_left == buf -> left_column) {
+    int shift = buf -> screen_line - (wrap_tree_prefix(buf, ed -> drawn_line) + ed -> drawn_wrap);
+    if (shift > -max_display_lines && shift < max_display_lines) {
+      if (shift != 0) {
+        setscrreg(0, max_display_lines - 1);
+        scrollok(stdscr, TRUE);
+        scrl(shift);
+        scrollok(stdscr, FALSE);
+      }
+      first_row = shift > 0 ? max_display_lines - shift : 0;
+      last_row = shift < 0 ? -shift : shift > 0 ? max_display_lines : 0;
+      // The top row is numbered even when it continues a wrapped line, so
+      // the old and new top rows differ from their scrolled copies
+      if (buf -> show_line_numbers && shift > 0) extra_row = 0;
+      if (buf -> show_line_numbers && shift < 0) last_row++;
     }
-    for (int w = 0; w < line -> wrap_count + 1 && displayed_lines < max_display_lines; w++) {
-      int end = (w < line -> wrap_count) ? line -> wrap_points[w] : line -> length;
-      if (i == file_line && w < wrap_index) {
+  }
+  buf -> dirty = 0;
+  ed -> drawn_lines = buf -> lines;
+  ed -> drawn_line = file_line;
+  ed -> drawn_wrap = wrap_index;
+  ed -> drawn_rows = max_display_lines;
+  ed -> drawn_wrap_gen = buf -> wrap_gen;
+  ed -> drawn_match_gen = buf -> match_gen;
+  ed -> drawn_numbers = buf -> show_line_numbers;
+  ed -> drawn_left = buf -> left_column;
+  for (int i = file_line; i < buf -> count && displayed_lines < last_row; i++) {
+    Line * line = buffer_line(buf, i);
+    int first_wrap = (i == file_line) ? wrap_index : 0;
+    const RenderLine * render = NULL;
+    int start = 0;
+    // A chopped line is a single row whatever it was last wrapped to
+    int wrap_count = buf -> chop_lines ? 0 : line -> wrap_count;
+    for (int w = 0; w < wrap_count + 1 && displayed_lines < last_row; w++) {
+      int end = (w < wrap_count) ? line -> wrap_points[w] : line -> length;
+      if (w < first_wrap) {
         start = end;
         continue;
       }
-      display_wrapped_line(line, start, end, displayed_lines, (buf -> show_line_numbers ? 6 : 0));
+      if (displayed_lines >= first_row || displayed_lines == extra_row) {
+        int x = buf -> show_line_numbers ? 6 : 0;
+        if (buf -> chop_lines) chop_columns(line, buf -> left_column, & start, & end, & x);
+        if (!render) {
+          // Runs are only needed as far as the last row this line gets
+          int last_wrap = w + last_row - displayed_lines - 1;
+          render = buffer_line_runs(buf, i, last_wrap < wrap_count ? line -> wrap_points[last_wrap] : buf -> chop_lines ? end : line -> length);
+        }
+        move(displayed_lines, 0);
+        clrtoeol();
+        if (buf -> show_line_numbers && w == first_wrap) printw("%4d ", i + 1);
+        if (render) display_wrapped_line(line, render, start, end, displayed_lines, x);
+      }
       start = end;
       displayed_lines++;
     }
   }
+  // Rows past the end of the file
+  for (; displayed_lines < last_row; displayed_lines++) {
+    if (displayed_lines < first_row && displayed_lines != extra_row) continue;
+    move(displayed_lines, 0);
+    clrtoeol();
+  }
   draw_status_bar(ed);
   refresh();
 }
@@ -15,6 +15,12 @@ Editor * editor_create() {
   ed -> command_mode = 0;
   ed -> search_mode = 0;
   ed -> last_search_direction = 1;
+  ed -> search_origin = 0;
+  ed -> search_origin_screen = 0;
+  ed -> search_pending = 0;
+  ed -> drawn_lines = NULL;
+  ed -> drawn_left = 0;
+  ed -> chop_lines = 0;
   return ed;
 }
 Buffer * editor_new_buffer(Editor * ed) {
@@ -24,45 +30,115 @@ Buffer * editor_new_buffer(Editor * ed) {
   Buffer * buf = & ed -> buffers[ed -> num_buffers];
   
   // Initialize buffer
-  buf -> lines = calloc(MAX_LINES, sizeof(Line));
+  buf -> lines = calloc(1, sizeof(LineTable));
   if (!buf -> lines) return NULL;  // If allocation fails, don't increment counter
   
   // Initialize other fields
-  buf -> capacity = MAX_LINES;
   buf -> count = 0;
   buf -> current_line = 0;
   buf -> screen_line = 0;
   buf -> top_line = 0;
   buf -> total_wrapped_lines = 0;
+  buf -> wrap_tree = NULL;
+  buf -> tree_count = 0;
+  buf -> tree_capacity = 0;
   buf -> filename = NULL;  // Ensure filename is initialized to NULL
+  buf -> map = NULL;
+  buf -> map_size = 0;
+  buf -> map_slot = -1;
+  buf -> text_arena.head = NULL;
+  buf -> tail = NULL;
+  buf -> tail_length = 0;
+  buf -> tail_capacity = 0;
+  buf -> wrap_arena.head = NULL;
+  buf -> wrap_width = 0;
+  buf -> wrap_gen = 0;
+  buf -> refine_pos = 0;
+  buf -> wrap_jobs = NULL;
+  buf -> show_line_numbers = 0;
+  buf -> chop_lines = ed -> chop_lines;
+  buf -> left_column = 0;
+  buf -> indexer = NULL;
+  buf -> search = NULL;
+  buf -> trigrams = NULL;
+  buf -> file_offset = -1;
+  buf -> follow_fd = -1;
+  buf -> follow_watch = -1;
+  buf -> follow_pending = 0;
+  buf -> pin_end = 0;
+  buf -> streaming = 0;
+  buf -> dirty = 0;
+  buf -> dropped = 0;
+  buf -> lex_first = 0;
+  buf -> lex_valid = 0;
+  buf -> lex_marks = NULL;
+  buf -> lex_chunks = 0;
+  buf -> lex_marks_capacity = 0;
+  buf -> lex_jobs = NULL;
+  buf -> lex_job_count = 0;
+  buf -> lex_job_capacity = 0;
+  buf -> render_cache = NULL;
+  buf -> match_gen = 0;
   
   // Only increment counter if everything succeeded
   ed -> num_buffers++;
   
   return buf;
 }
+void buffer_destroy(Buffer * buf) {
+  follow_stop(buf);
+  stream_detach(buf);
+  indexer_stop(buf);
+  trigram_stop(buf);
+  buffer_cancel_wraps(buf);
+  buffer_cancel_lex(buf);
+  buffer_cancel_search(buf);
+  search_wait_orphans();
+  render_cache_free(buf);
+  line_table_free(buf -> lines);
+  free(buf -> wrap_tree);
+  arena_reset( & buf -> text_arena);
+  arena_reset( & buf -> wrap_arena);
+  free(buf -> tail);
+  free(buf -> filename);
+  buffer_unmap(buf);
+}
+// Drops every line so the file can be loaded again from its start. The
+// name, the follow descriptor and the view settings are kept.
+void buffer_clear(Buffer * buf) {
+  indexer_stop(buf);
+  trigram_stop(buf);
+  buffer_cancel_lex(buf);
+  buffer_cancel_search(buf);
+  search_wait_orphans();
+  render_cache_free(buf);
+  buffer_rewrap(buf, buffer_text_width(buf));
+  arena_reset( & buf -> text_arena);
+  buffer_unmap(buf);
+  buf -> tail_length = 0;
+  buf -> count = 0;
+  buf -> current_line = 0;
+  buf -> screen_line = 0;
+  buf -> top_line = 0;
+  buf -> file_offset = 0;
+  buf -> left_column = 0;
+  buf -> dirty = 1;
+  buf -> dropped = 0;
+}
 void editor_destroy(Editor * ed) {
   if (!ed) return;
   for (int b = 0; b < ed -> num_buffers; b++) {
-    Buffer * buf = & ed -> buffers[b];
-    for (int i = 0; i < buf -> count; i++) {
-      free(buf -> lines[i].content);
-      free(buf -> lines[i].wrap_points);
-    }
-    free(buf -> lines);
-    free(buf -> filename);
+    buffer_destroy( & ed -> buffers[b]);
   }
   free(ed -> buffers);
   free(ed);
 }
 int get_display_width(const char * str, int len) {
   int width = 0;
-  for (int i = 0; i < len; i++) {
-    if (str[i] == '\t') {
-      width += TAB_SIZE - (width % TAB_SIZE);
-    } else if (isprint(str[i])) {
-      width++;
-    }
+  for (int i = 0; i < len;) {
+    int bytes;
+    width += screen_char_width(str + i, str + len, width, & bytes);
+    i += bytes;
   }
   return width;
 }
@@ -76,7 +152,22 @@ void draw_status_bar(Editor * ed) {
   move(y - 2, 0);
   int percent = (buf -> count <= 1) ? 100 : (buf -> current_line >= buf -> count - 1) ? 100 : (int)((float)(buf -> current_line + 1) / buf -> count * 100);
   char status_message[MAX_LINE_LENGTH];
-  snprintf(status_message, sizeof(status_message), " [%d/%d] %s | Line %d/%d (%d%%) | ':n' next | ':p' prev | ':q' close | '/' search", ed -> current_buffer + 1, ed -> num_buffers, buf -> filename, buf -> current_line + 1, buf -> count, percent);
+  int progress = buffer_index_progress(buf);
+  const char * following = buf -> dropped ? " (out of memory, incomplete)" : buf -> follow_fd >= 0 ? " (following)" : buf -> streaming ? " (reading)" : "";
+  char matches[64] = "";
+  int match_count = buffer_match_count(buf);
+  if (match_count >= 0) {
+    int rank = buffer_match_current(buf);
+    if (rank >= 0) snprintf(matches, sizeof(matches), " | match %d of %d", rank + 1, match_count);
+    else snprintf(matches, sizeof(matches), " | %d matches", match_count);
+  } else if (buf -> search) {
+    snprintf(matches, sizeof(matches), " | searching");
+  }
+  if (progress >= 0) {
+    snprintf(status_message, sizeof(status_message), " [%d/%d] %s%s | Line %d/%d+ (indexing %d%%)%s | ':n' next | ':p' prev | ':q' close | '/' search", ed -> current_buffer + 1, ed -> num_buffers, buf -> filename, following, buf -> current_line + 1, buf -> count, progress, matches);
+  } else {
+    snprintf(status_message, sizeof(status_message), " [%d/%d] %s%s | Line %d/%d (%d%%)%s | ':n' next | ':p' prev | ':q' close | '/' search", ed -> current_buffer + 1, ed -> num_buffers, buf -> filename, following, buf -> current_line + 1, buf -> count, percent, matches);
+  }
   addstr(status_message);
   attroff(COLOR_PAIR(8) | A_BOLD);
   attron(COLOR_PAIR(9));
@@ -89,14 +180,18 @@ void draw_status_bar(Editor * ed) {
   }
   attroff(COLOR_PAIR(9));
 }
+volatile sig_atomic_t resize_pending = 0;
 void handle_resize(int sig) {
   (void) sig;
-  if (GLOBAL_EDITOR) {
-    endwin();
-    refresh();
-    clear();
-    recalculate_wraps(GLOBAL_EDITOR);
-    display_lines(GLOBAL_EDITOR);
-  }
+  // Only flag the resize and wake the event loop, which rewraps and redraws
+  // outside the handler
+  resize_pending = 1;
+  event_signal();
+}
+void apply_resize(Editor * ed) {
+  resize_pending = 0;
+  endwin();
+  refresh();
+  clear();
+  recalculate_wraps(ed);
 }
-
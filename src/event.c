@@ -0,0 +1,96 @@
+#include "../include/least.h"
+
+typedef struct {
+  int fd;
+  void( * callback)(Editor * ed, int fd, void * arg);
+  void * arg;
+} EventWatch;
+
+static int signal_pipe[2] = {-1, -1};
+static int wake_pipe[2] = {-1, -1};
+static EventWatch watches[EVENT_MAX_WATCHES];
+static int watch_count = 0;
+
+int event_pipe(int fds[2]) {
+  if (pipe(fds) < 0) return -1;
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  return 0;
+}
+int event_init(void) {
+  if (event_pipe(signal_pipe) < 0) return -1;
+  if (event_pipe(wake_pipe) < 0) return -1;
+  return 0;
+}
+void event_signal(void) {
+  // Async-signal-safe: called from signal handlers
+  int saved_errno = errno;
+  if (signal_pipe[1] >= 0) {
+    ssize_t ret = write(signal_pipe[1], "s", 1);
+    (void) ret;
+  }
+  errno = saved_errno;
+}
+void event_wake(void) {
+  if (wake_pipe[1] >= 0) {
+    ssize_t ret = write(wake_pipe[1], "w", 1);
+    (void) ret;
+  }
+}
+int event_watch(int fd, void( * callback)(Editor * ed, int fd, void * arg), void * arg) {
+  if (watch_count >= EVENT_MAX_WATCHES) return -1;
+  watches[watch_count].fd = fd;
+  watches[watch_count].callback = callback;
+  watches[watch_count].arg = arg;
+  watch_count++;
+  return 0;
+}
+void event_unwatch(int fd) {
+  for (int i = 0; i < watch_count; i++) {
+    if (watches[i].fd == fd) {
+      watches[i] = watches[--watch_count];
+      return;
+    }
+  }
+}
+void event_drain(int fd) {
+  char buf[256];
+  while (read(fd, buf, sizeof(buf)) > 0);
+}
+long event_now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, & now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+int event_wait(Editor * ed, int timeout_ms) {
+  struct pollfd fds[3 + EVENT_MAX_WATCHES];
+  EventWatch ready[EVENT_MAX_WATCHES];
+  int nfds = 0;
+  fds[nfds].fd = STDIN_FILENO;
+  fds[nfds++].events = POLLIN;
+  fds[nfds].fd = signal_pipe[0];
+  fds[nfds++].events = POLLIN;
+  fds[nfds].fd = wake_pipe[0];
+  fds[nfds++].events = POLLIN;
+  int watched = watch_count;
+  for (int i = 0; i < watched; i++) {
+    fds[nfds].fd = watches[i].fd;
+    fds[nfds++].events = POLLIN;
+  }
+  if (poll(fds, nfds, timeout_ms) <= 0) return 0;
+  if (fds[1].revents & POLLIN) event_drain(signal_pipe[0]);
+  if (fds[2].revents & POLLIN) event_drain(wake_pipe[0]);
+  // Callbacks may add or remove watches, so dispatch from a snapshot
+  int ready_count = 0;
+  for (int i = 0; i < watched; i++) {
+    if (fds[3 + i].revents & (POLLIN | POLLHUP | POLLERR)) ready[ready_count++] = watches[i];
+  }
+  for (int i = 0; i < ready_count; i++) {
+    ready[i].callback(ed, ready[i].fd, ready[i].arg);
+  }
+  if (fds[0].revents & POLLIN) return 1;
+  // The terminal went away
+  return (fds[0].revents & (POLLHUP | POLLERR)) ? -1 : 0;
+}
@@ -0,0 +1,84 @@
+#include "../include/least.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+void follow_notify(Editor * ed, int fd, void * arg) {
+  (void) arg;
+  char events[4096] __attribute__((aligned(8)));
+  while (read(fd, events, sizeof(events)) > 0);
+  for (int b = 0; b < ed -> num_buffers; b++) {
+    if (ed -> buffers[b].follow_watch == fd) ed -> buffers[b].follow_pending = 1;
+  }
+}
+int follow_start(Buffer * buf) {
+  if (buf -> follow_fd >= 0) return 0;
+  if (!buf -> filename || buf -> file_offset < 0) return -1;
+  int fd = open(buf -> filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  buf -> follow_fd = fd;
+  buf -> follow_pending = 1;
+#ifdef __linux__
+  int watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch >= 0) {
+    if (inotify_add_watch(watch, buf -> filename, IN_MODIFY) >= 0 && event_watch(watch, follow_notify, NULL) == 0) {
+      buf -> follow_watch = watch;
+    } else {
+      close(watch);
+    }
+  }
+#endif
+  return 0;
+}
+void follow_stop(Buffer * buf) {
+  if (buf -> follow_fd < 0) return;
+  // Nothing more will finish a partly written last line
+  buffer_search_appended(buf, buffer_flush_tail(buf));
+  if (buf -> follow_watch >= 0) {
+    event_unwatch(buf -> follow_watch);
+    close(buf -> follow_watch);
+    buf -> follow_watch = -1;
+  }
+  close(buf -> follow_fd);
+  buf -> follow_fd = -1;
+  buf -> follow_pending = 0;
+}
+// Loads whatever was appended since the last call. At most FOLLOW_READ_MAX
+// bytes are read at a time so a burst is spread over several passes of the
+// event loop; returns 1 if more is already waiting.
+int follow_update(Buffer * buf) {
+  // Appended lines go after the indexer's, so let it finish first
+  if (buf -> follow_fd < 0 || !buf -> follow_pending || buf -> indexer) return 0;
+  // Without inotify the file is checked on every poll
+  buf -> follow_pending = buf -> follow_watch < 0;
+  struct stat st;
+  if (fstat(buf -> follow_fd, & st) < 0) return 0;
+  if (st.st_size < buf -> file_offset) {
+    // Truncated in place, as by logrotate's copytruncate. Mapped lines may
+    // now lie past the end of the file, so start over from the top the way
+    // tail -F does.
+    if (buffer_reload(buf, buf -> follow_fd) < 0) {
+      follow_stop(buf);
+      return 0;
+    }
+    buf -> pin_end = 1;
+    return 0;
+  }
+  size_t size = st.st_size - buf -> file_offset;
+  if (size == 0) return 0;
+  if (size > FOLLOW_READ_MAX) size = FOLLOW_READ_MAX;
+  char * data = arena_alloc( & buf -> text_arena, size);
+  if (!data) return 0;
+  ssize_t got = pread(buf -> follow_fd, data, size, buf -> file_offset);
+  if (got <= 0) return 0;
+  buf -> file_offset += got;
+  int pinned = buffer_at_end(buf);
+  int first = buffer_append_text(buf, data, got);
+  buffer_search_appended(buf, first);
+  if (pinned) buffer_scroll_to_end(buf);
+  if (buf -> file_offset < st.st_size) {
+    buf -> follow_pending = 1;
+    return 1;
+  }
+  return 0;
+}
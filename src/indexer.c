@@ -0,0 +1,102 @@
+#include "../include/least.h"
+
+void indexer_publish(LineIndexer * ix, int indexed, size_t offset) {
+  pthread_mutex_lock( & ix -> lock);
+  __atomic_store_n( & ix -> offset, offset, __ATOMIC_RELEASE);
+  __atomic_store_n( & ix -> indexed, indexed, __ATOMIC_RELEASE);
+  pthread_cond_broadcast( & ix -> progress);
+  pthread_mutex_unlock( & ix -> lock);
+}
+void * indexer_run(void * arg) {
+  LineIndexer * ix = arg;
+  const char * pos = ix -> data;
+  const char * end = ix -> data + ix -> size;
+  const char * ends[INDEX_BATCH_LINES];
+  int count = 0;
+  while (pos < end) {
+    int found = scan_line_ends(pos, end, SCAN_NEWLINE, ends, INDEX_BATCH_LINES);
+    // The last line may have no newline
+    if (found == 0) ends[found++] = end - 1;
+    int i;
+    for (i = 0; i < found; i++) {
+      Line * line = line_table_slot(ix -> lines, count);
+      if (!line) break;
+      line_init(line, pos, ends[i] + 1 - pos, 0);
+      count++;
+      pos = ends[i] + 1;
+    }
+    if (i < found) break;
+    indexer_publish(ix, count, pos - ix -> data);
+    if (__atomic_load_n( & ix -> cancel, __ATOMIC_ACQUIRE)) break;
+  }
+  indexer_publish(ix, count, pos - ix -> data);
+  pthread_mutex_lock( & ix -> lock);
+  __atomic_store_n( & ix -> done, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast( & ix -> progress);
+  pthread_mutex_unlock( & ix -> lock);
+  event_wake();
+  return NULL;
+}
+int indexer_start(Buffer * buf,
+  const char * data, size_t size) {
+  LineIndexer * ix = calloc(1, sizeof(LineIndexer));
+  if (!ix) return -1;
+  ix -> lines = buf -> lines;
+  ix -> data = data;
+  ix -> size = size;
+  pthread_mutex_init( & ix -> lock, NULL);
+  pthread_cond_init( & ix -> progress, NULL);
+  if (pthread_create( & ix -> thread, NULL, indexer_run, ix) != 0) {
+    pthread_mutex_destroy( & ix -> lock);
+    pthread_cond_destroy( & ix -> progress);
+    free(ix);
+    return -1;
+  }
+  buf -> indexer = ix;
+  return 0;
+}
+void indexer_free(Buffer * buf) {
+  LineIndexer * ix = buf -> indexer;
+  pthread_join(ix -> thread, NULL);
+  pthread_mutex_destroy( & ix -> lock);
+  pthread_cond_destroy( & ix -> progress);
+  free(ix);
+  buf -> indexer = NULL;
+}
+void indexer_stop(Buffer * buf) {
+  if (!buf -> indexer) return;
+  __atomic_store_n( & buf -> indexer -> cancel, 1, __ATOMIC_RELEASE);
+  indexer_free(buf);
+}
+void buffer_sync(Buffer * buf) {
+  LineIndexer * ix = buf -> indexer;
+  if (!ix) return;
+  // Read done before indexed so a finished indexer is seen with its final count
+  int done = __atomic_load_n( & ix -> done, __ATOMIC_ACQUIRE);
+  int indexed = __atomic_load_n( & ix -> indexed, __ATOMIC_ACQUIRE);
+  // Rows past the old last line are blank on screen until redrawn
+  if (indexed != buf -> count) buf -> dirty = 1;
+  buf -> count = indexed;
+  if (done) indexer_free(buf);
+}
+void buffer_wait_lines(Buffer * buf, int lines) {
+  LineIndexer * ix = buf -> indexer;
+  if (!ix) return;
+  pthread_mutex_lock( & ix -> lock);
+  while (ix -> indexed < lines && !ix -> done) {
+    pthread_cond_wait( & ix -> progress, & ix -> lock);
+  }
+  pthread_mutex_unlock( & ix -> lock);
+  buffer_sync(buf);
+}
+void buffer_wait_screen_line(Buffer * buf, int screen_line) {
+  while (buf -> indexer && wrap_tree_total(buf) <= screen_line) {
+    buffer_wait_lines(buf, buf -> count + INDEX_BATCH_LINES);
+  }
+}
+int buffer_index_progress(const Buffer * buf) {
+  LineIndexer * ix = buf -> indexer;
+  if (!ix || ix -> size == 0) return -1;
+  size_t offset = __atomic_load_n( & ix -> offset, __ATOMIC_ACQUIRE);
+  return (int)(offset * 100 / ix -> size);
+}
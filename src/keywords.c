@@ -0,0 +1,76 @@
+#include "../include/least.h"
+extern struct SyntaxPattern syntax_patterns[];
+
+// syntax_patterns[] folded into a case-insensitive trie, so finding the
+// keyword at a position costs one step per character instead of one
+// comparison per pattern
+typedef struct {
+  unsigned char c;
+  short child; // first child, -1 if none
+  short sibling;
+  short pattern; // earliest syntax_patterns entry ending here, -1 if none
+} KeywordNode;
+
+static KeywordNode * keyword_nodes = NULL;
+static short keyword_root[256];
+
+short keyword_child(short node, unsigned char c) {
+  for (short child = keyword_nodes[node].child; child >= 0; child = keyword_nodes[child].sibling) {
+    if (keyword_nodes[child].c == c) return child;
+  }
+  return -1;
+}
+int keyword_build(void) {
+  int total = 0;
+  for (int i = 0; syntax_patterns[i].pattern != NULL; i++) total += strlen(syntax_patterns[i].pattern);
+  keyword_nodes = malloc((total + 1) * sizeof(KeywordNode));
+  if (!keyword_nodes) return -1;
+  for (int c = 0; c < 256; c++) keyword_root[c] = -1;
+  int count = 0;
+  for (int i = 0; syntax_patterns[i].pattern != NULL; i++) {
+    const unsigned char * p = (const unsigned char * ) syntax_patterns[i].pattern;
+    if (! * p) continue;
+    short node = -1;
+    for (; * p; p++) {
+      unsigned char c = tolower( * p);
+      short next = node < 0 ? keyword_root[c] : keyword_child(node, c);
+      if (next < 0) {
+        next = count++;
+        keyword_nodes[next].c = c;
+        keyword_nodes[next].child = -1;
+        keyword_nodes[next].pattern = -1;
+        if (node < 0) {
+          keyword_nodes[next].sibling = -1;
+          keyword_root[c] = next;
+        } else {
+          keyword_nodes[next].sibling = keyword_nodes[node].child;
+          keyword_nodes[node].child = next;
+        }
+      }
+      node = next;
+    }
+    // A repeated pattern keeps the colour of its first entry
+    if (keyword_nodes[node].pattern < 0) keyword_nodes[node].pattern = i;
+  }
+  return 0;
+}
+// The syntax pattern starting at pos that the highlighter would pick: of
+// those ending before a non-alphanumeric character, the earliest entry.
+// The end of the text counts as non-alphanumeric. Returns its index with
+// its length in length, or -1.
+int keyword_match(const char * pos, const char * end, int * length) {
+  if (!keyword_nodes && keyword_build() < 0) return -1;
+  int best = -1;
+  if (pos >= end) return -1;
+  short node = keyword_root[(unsigned char) tolower((unsigned char) pos[0])];
+  for (int depth = 1; node >= 0; depth++) {
+    int pattern = keyword_nodes[node].pattern;
+    if (pattern >= 0 && (best < 0 || pattern < best) && (pos + depth == end || !isalnum((unsigned char) pos[depth]))) {
+      best = pattern;
+      * length = depth;
+    }
+    if (pos + depth == end || pos[depth] == '\0') break;
+    node = keyword_child(node, tolower((unsigned char) pos[depth]));
+  }
+  return best;
+}
@@ -28,341 +28,221 @@ struct SyntaxPattern syntax_patterns[] = {
   {NULL, 0}
 };
 void recalculate_wraps(Editor * ed) {
-  Buffer * buf = current_buffer(ed);
-  if (!buf) return;
-  int screen_width = COLS;
-  buf -> total_wrapped_lines = 0;
-  for (int i = 0; i < buf -> count; i++) {
-    calculate_line_wraps( & buf -> lines[i], screen_width);
-    buf -> total_wrapped_lines += buf -> lines[i].wrapped_lines;
+  // The visible buffer is scheduled first so its lines reach the workers first
+  Buffer * current = current_buffer(ed);
+  if (!current) return;
+  buffer_rewrap(current, buffer_text_width(current));
+  buffer_schedule_wraps(current);
+  for (int b = 0; b < ed -> num_buffers; b++) {
+    Buffer * buf = & ed -> buffers[b];
+    if (buf == current) continue;
+    buffer_rewrap(buf, buffer_text_width(buf));
+    buffer_schedule_wraps(buf);
   }
 }
-int editor_append_line(Buffer * buf,
-  const char * content, int length) {
-  if (!buf || buf -> count >= buf -> capacity) return -1;
-  buf -> lines[buf -> count].content = strndup(content, length);
-  if (!buf -> lines[buf -> count].content) return -1;
-  buf -> lines[buf -> count].length = length;
-  buf -> lines[buf -> count].allocated = length + 1;
-  buf -> lines[buf -> count].wrap_points = NULL;
-  buf -> lines[buf -> count].wrap_count = 0;
-  buf -> lines[buf -> count].wrapped_lines = 1;
-  buf -> lines[buf -> count].matches.matches = NULL;
-  buf -> lines[buf -> count].matches.count = 0;
-  buf -> lines[buf -> count].matches.capacity = 0;
-  buf -> count++;
-  return 0;
-}
-void highlight_syntax(const char * line) {
-  int in_string = 0, in_char = 0, in_multiline_comment = 0, in_single_comment = 0;
-  char prev_char = '\0';
-  for (const char * pos = line;* pos != '\0'; pos++) {
-    if (!in_string && !in_char) {
-      if (pos[0] == '/' && pos[1] == '*' && !in_single_comment) {
-        in_multiline_comment = 1;
-        attron(COLOR_PAIR(4));
-        addstr("");
-        attroff(COLOR_PAIR(4));
-        pos++;
-        continue;
-      }
-      if (pos[0] == '/' && pos[1] == '/' && !in_multiline_comment) {
-        in_single_comment = 1;
-        attron(COLOR_PAIR(4));
-      }
+// Extends render's runs from where they stop to at least byte limit,
+// picking the lexer up in the state it was left in
+void highlight_syntax(const Line * line, RenderLine * render,
+  const SearchMatch * matches, int match_count, int limit) {
+  const char * text = line -> content;
+  const char * end = text + line -> length;
+  int pos = render -> built;
+  int state = render -> state;
+  while (pos < limit) {
+    int class = lex_char(text, pos, line -> length, & state);
+    if (class == LEX_CLASS_COMMENT) {
+      render_add(render, matches, match_count, pos, pos + 1, COLOR_PAIR(4));
+      pos++;
+      continue;
     }
-    if (!in_multiline_comment && !in_single_comment) {
-      if ( * pos == '"' && prev_char != '\\') {
-        in_string = !in_string;
-        attron(COLOR_PAIR(5));
-      }
-      if ( * pos == '\'' && prev_char != '\\') {
-        in_char = !in_char;
-        attron(COLOR_PAIR(5));
-      }
+    if (class == LEX_CLASS_STRING) {
+      render_add(render, matches, match_count, pos, pos + 1, COLOR_PAIR(5));
+      pos++;
+      continue;
     }
-    if (in_multiline_comment || in_single_comment) {
-      attron(COLOR_PAIR(4));
-      addch( * pos);
-    } else if (in_string || in_char) {
-      attron(COLOR_PAIR(5));
-      addch( * pos);
-    } else {
-      int pattern_matched = 0;
-      for (int i = 0; syntax_patterns[i].pattern != NULL; i++) {
-        int len = strlen(syntax_patterns[i].pattern);
-        if (strncasecmp(pos, syntax_patterns[i].pattern, len) == 0 &&
-          (pos == line || !isalnum( * (pos - 1)) || ispunct( * (pos - 1))) &&
-          (!isalnum( * (pos + len)) || * (pos + len) == '\0' || ispunct( * (pos + len)))) {
-          attron(COLOR_PAIR(syntax_patterns[i].color_pair));
-          for (int j = 0; j < len; j++) {
-            addch( * (pos + j));
-          }
-          attroff(COLOR_PAIR(syntax_patterns[i].color_pair));
-          pos += len - 1;
-          pattern_matched = 1;
-          break;
-        }
-      }
-      if (!pattern_matched) {
-        if (isdigit( * pos) || ( * pos == '-' && isdigit( * (pos + 1)))) {
-          attron(COLOR_PAIR(6));
-          addch( * pos);
-          attroff(COLOR_PAIR(6));
-        } else if (strchr("+-*/%=<>!&|^~", * pos)) {
-          attron(COLOR_PAIR(7));
-          addch( * pos);
-          attroff(COLOR_PAIR(7));
-        } else {
-          addch( * pos);
-        }
-      }
+    // Keywords only start after a non-alphanumeric character. None of them
+    // contains a character that changes the lexer state.
+    int len = 0;
+    int pattern = (pos == 0 || !isalnum((unsigned char) text[pos - 1])) ? keyword_match(text + pos, end, & len) : -1;
+    if (pattern >= 0) {
+      render_add(render, matches, match_count, pos, pos + len, COLOR_PAIR(syntax_patterns[pattern].color_pair));
+      pos += len;
+      continue;
     }
-    prev_char = * pos;
-    if ( * pos == '\n') {
-      in_single_comment = 0;
-      attroff(COLOR_PAIR(4));
+    char c = text[pos];
+    attr_t attr = A_NORMAL;
+    if (isdigit(c) || (c == '-' && pos + 1 < line -> length && isdigit(text[pos + 1]))) {
+      attr = COLOR_PAIR(6);
+    } else if (c != '\0' && strchr("+-*/%=<>!&|^~", c)) {
+      attr = COLOR_PAIR(7);
     }
+    render_add(render, matches, match_count, pos, pos + 1, attr);
+    pos++;
   }
+  render -> built = pos;
+  render -> state = state;
 }
 void screen_to_file_position(Editor * ed, int screen_line, int * file_line, int * wrap_index) {
   Buffer * buf = current_buffer(ed);
   if (!buf) return;
-  int current_screen_line = 0;
-  for (int i = 0; i < buf -> count; i++) {
-    if (current_screen_line + buf -> lines[i].wrapped_lines > screen_line) {
-      * file_line = i;
-      * wrap_index = screen_line - current_screen_line;
-      return;
-    }
-    current_screen_line += buf -> lines[i].wrapped_lines;
-  }
-  * file_line = buf -> count - 1;
-  * wrap_index = buf -> lines[ * file_line].wrapped_lines - 1;
+  wrap_tree_find(buf, screen_line, file_line, wrap_index);
 }
-void display_wrapped_line(const Line * line, int start, int end, int y, int x) {
-  move(y, x);
-  if (line -> matches.count == 0) {
-    char * temp = malloc(end - start + 1);
-    if (!temp) return;
-    strncpy(temp, line -> content + start, end - start);
-    temp[end - start] = '\0';
-    highlight_syntax(temp);
-    free(temp);
-    return;
-  }
-  int current_pos = start;
-  for (int i = 0; i < line -> matches.count; i++) {
-    SearchMatch match = line -> matches.matches[i];
-    if (match.end <= start) continue;
-    if (match.start >= end) break;
-    if (current_pos < match.start) {
-      int len = match.start - current_pos;
-      char * temp = malloc(len + 1);
-      if (!temp) continue;
-      strncpy(temp, line -> content + current_pos, len);
-      temp[len] = '\0';
-      highlight_syntax(temp);
-      free(temp);
-    }
-    int match_start = (match.start > start) ? match.start : start;
-    int match_end = (match.end < end) ? match.end : end;
-    int len = match_end - match_start;
-    if (len > 0) {
-      char * temp = malloc(len + 1);
-      if (!temp) continue;
-      strncpy(temp, line -> content + match_start, len);
-      temp[len] = '\0';
-      attron(COLOR_PAIR(10));
-      addstr(temp);
-      attroff(COLOR_PAIR(10));
-      free(temp);
+// Copies cells to the window at y, x and moves past them, continuing on
+// the next row at the right edge the way addch does
+void draw_cells(int * y, int * x, const chtype * cells, int count) {
+  while (count > 0 && * x < COLS) {
+    int n = COLS - * x < count ? COLS - * x : count;
+    mvaddchnstr( * y, * x, cells, n);
+    * x += n;
+    cells += n;
+    count -= n;
+    if ( * x == COLS && * y + 1 < LINES) {
+      ( * y)++;
+      * x = 0;
     }
-    current_pos = match_end;
-  }
-  if (current_pos < end) {
-    int len = end - current_pos;
-    char * temp = malloc(len + 1);
-    if (!temp) return;
-    strncpy(temp, line -> content + current_pos, len);
-    temp[len] = '\0';
-    highlight_syntax(temp);
-    free(temp);
   }
 }
-bool search_forward(Editor * ed,
-  const char * term) {
-  Buffer * buf = current_buffer(ed);
-  if (!buf || !term || strlen(term) == 0) return false;
-  for (int i = 0; i < buf -> count; i++) {
-    free(buf -> lines[i].matches.matches);
-    buf -> lines[i].matches.matches = NULL;
-    buf -> lines[i].matches.count = 0;
-    buf -> lines[i].matches.capacity = 0;
+// Bytes [start, end) of a chopped line that show when it is scrolled left
+// columns and drawn from column x to the right edge, and the column x the
+// first of them lands on. Characters cut by either edge are left out.
+void chop_columns(const Line * line, int left, int * start, int * end, int * x) {
+  const char * text = line -> content;
+  const char * stop = text + line -> length;
+  int pos = 0, column = 0, bytes;
+  while (pos < line -> length && column < left) {
+    column += screen_char_width(text + pos, stop, column, & bytes);
+    pos += bytes;
   }
-  regex_t regex;
-  int ret = regcomp( & regex, term, REG_EXTENDED | REG_NEWLINE);
-  if (ret) {
-    mvprintw(LINES - 1, 0, "Invalid regex pattern");
-    clrtoeol();
-    refresh();
-    napms(1000);
-    return false;
+  * start = pos;
+  * x += column - left;
+  for (column = * x; pos < line -> length; pos += bytes) {
+    int w = screen_char_width(text + pos, stop, column, & bytes);
+    if (column + w > COLS) break;
+    column += w;
   }
-  regmatch_t pmatch[1];
-  bool found = false;
-  int first_match_line = -1;
-  for (int i = buf -> current_line; i < buf -> count; i++) {
-    char * line_content = buf -> lines[i].content;
-    int offset = 0;
-    while (regexec( & regex, line_content + offset, 1, pmatch, 0) == 0) {
-      if (buf -> lines[i].matches.count >= buf -> lines[i].matches.capacity) {
-        int new_capacity = buf -> lines[i].matches.capacity == 0 ? 4 : buf -> lines[i].matches.capacity * 2;
-        SearchMatch * new_matches = realloc(buf -> lines[i].matches.matches, new_capacity * sizeof(SearchMatch));
-        if (!new_matches) break;
-        buf -> lines[i].matches.matches = new_matches;
-        buf -> lines[i].matches.capacity = new_capacity;
-      }
-      SearchMatch match = {
-        .start = offset + pmatch[0].rm_so,
-        .end = offset + pmatch[0].rm_eo
-      };
-      buf -> lines[i].matches.matches[buf -> lines[i].matches.count++] = match;
-      if (!found) {
-        found = true;
-        first_match_line = i;
-      }
-      offset += pmatch[0].rm_eo;
-      if (pmatch[0].rm_so == pmatch[0].rm_eo) break;
-    }
+  * end = pos;
+}
+// Draws bytes [start, end) of a line from its runs. Printable ASCII is
+// copied into the window as cells a batch at a time; anything else goes
+// through ncurses so it expands tabs and control characters as before and
+// lays out multibyte ones.
+void display_wrapped_line(const Line * line,
+  const RenderLine * render, int start, int end, int y, int x) {
+  chtype cells[DRAW_BATCH];
+  int count = 0;
+  int lo = 0, hi = render -> count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (render -> runs[mid].end <= start) lo = mid + 1;
+    else hi = mid;
   }
-  if (!found) {
-    for (int i = 0; i < buf -> current_line; i++) {
-      char * line_content = buf -> lines[i].content;
-      int offset = 0;
-      while (regexec( & regex, line_content + offset, 1, pmatch, 0) == 0) {
-        if (buf -> lines[i].matches.count >= buf -> lines[i].matches.capacity) {
-          int new_capacity = buf -> lines[i].matches.capacity == 0 ? 4 : buf -> lines[i].matches.capacity * 2;
-          SearchMatch * new_matches = realloc(buf -> lines[i].matches.matches, new_capacity * sizeof(SearchMatch));
-          if (!new_matches) break;
-          buf -> lines[i].matches.matches = new_matches;
-          buf -> lines[i].matches.capacity = new_capacity;
+  for (int i = lo; i < render -> count && render -> runs[i].start < end; i++) {
+    const CellRun * run = & render -> runs[i];
+    int from = run -> start > start ? run -> start : start;
+    int to = run -> end < end ? run -> end : end;
+    for (int pos = from; pos < to; pos++) {
+      unsigned char c = line -> content[pos];
+      if (c >= ' ' && c < 0x7f) {
+        if (count == DRAW_BATCH) {
+          draw_cells( & y, & x, cells, count);
+          count = 0;
         }
-        SearchMatch match = {
-          .start = offset + pmatch[0].rm_so,
-          .end = offset + pmatch[0].rm_eo
-        };
-        buf -> lines[i].matches.matches[buf -> lines[i].matches.count++] = match;
-        if (!found) {
-          found = true;
-          first_match_line = i;
-        }
-        offset += pmatch[0].rm_eo;
-        if (pmatch[0].rm_so == pmatch[0].rm_eo) break;
+        cells[count++] = c | run -> attr;
+        continue;
       }
+      draw_cells( & y, & x, cells, count);
+      count = 0;
+      move(y, x);
+      attrset(run -> attr);
+      if (c >= 0x80 && MB_CUR_MAX > 1) {
+        // Whole characters, so ncurses can place wide and combining ones
+        int bytes;
+        if (char_width(line -> content + pos, line -> content + to, & bytes) < 0) addch('?');
+        else addnstr(line -> content + pos, bytes);
+        pos += bytes - 1;
+      } else {
+        addch(c);
+      }
+      attrset(A_NORMAL);
+      getyx(stdscr, y, x);
     }
   }
-  regfree( & regex);
-  if (found) {
-    buf -> current_line = first_match_line;
-    buf -> screen_line = 0;
-    for (int j = 0; j < first_match_line; j++) {
-      buf -> screen_line += buf -> lines[j].wrapped_lines;
-    }
-    return true;
-  }
-  return false;
+  draw_cells( & y, & x, cells, count);
+}
+// Shows why a search could not run, if it could not; returns 1 then
+int search_failed(int line) {
+  if (line != SEARCH_INVALID && line != SEARCH_NO_MEMORY) return 0;
+  mvprintw(LINES - 1, 0, line == SEARCH_INVALID ? "Invalid regex pattern" : "Not enough memory to search");
+  clrtoeol();
+  refresh();
+  napms(1000);
+  return 1;
 }
-void search_backward(Editor * ed,
+bool search_forward(Editor * ed,
   const char * term) {
   Buffer * buf = current_buffer(ed);
-  if (!buf || !term || strlen(term) == 0) return;
-  for (int i = 0; i < buf -> count; i++) {
-    free(buf -> lines[i].matches.matches);
-    buf -> lines[i].matches.matches = NULL;
-    buf -> lines[i].matches.count = 0;
-    buf -> lines[i].matches.capacity = 0;
+  if (!buf || !term || strlen(term) == 0) return false;
+  int line = buffer_search(buf, term, 1);
+  if (search_failed(line)) return false;
+  if (line < 0) return false;
+  buf -> current_line = line;
+  buf -> screen_line = wrap_tree_prefix(buf, line);
+  return true;
+}
+// n and p: steps to the next or previous match of the last pattern
+void search_step(Editor * ed, int direction) {
+  Buffer * buf = current_buffer(ed);
+  if (!buf || strlen(ed -> search_buffer) == 0) return;
+  int line = buffer_search_next(buf, ed -> search_buffer, direction);
+  if (search_failed(line)) return;
+  if (line < 0) return;
+  buf -> current_line = line;
+  buf -> screen_line = wrap_tree_prefix(buf, line);
+}
+void search_restore_origin(Editor * ed) {
+  Buffer * buf = current_buffer(ed);
+  buf -> current_line = ed -> search_origin;
+  buf -> screen_line = ed -> search_origin_screen;
+}
+// Jumps to the incremental search's nearest match once it is known; returns
+// 1 if the view changed
+int search_poll(Editor * ed) {
+  if (!ed -> search_pending) return 0;
+  Buffer * buf = current_buffer(ed);
+  int line = buffer_search_nearest(buf, 0);
+  if (line == SEARCH_PENDING) return 0;
+  ed -> search_pending = 0;
+  if (line < 0) {
+    search_restore_origin(ed);
+  } else {
+    buf -> current_line = line;
+    buf -> screen_line = wrap_tree_prefix(buf, line);
   }
-  regex_t regex;
-  int ret = regcomp( & regex, term, REG_EXTENDED | REG_NEWLINE);
-  if (ret) {
-    mvprintw(LINES - 1, 0, "Invalid regex pattern");
-    clrtoeol();
-    refresh();
-    napms(1000);
+  return 1;
+}
+// Restarts the search from where '/' was pressed each time the pattern
+// changes; the previous scan is cancelled by starting the new one
+void search_incremental(Editor * ed) {
+  Buffer * buf = current_buffer(ed);
+  if (ed -> search_buffer[0] == '\0') {
+    buffer_cancel_search(buf);
+    search_restore_origin(ed);
+    ed -> search_pending = 0;
     return;
   }
-  regmatch_t pmatch[1];
-  bool found = false;
-  int last_match_line = -1;
-  for (int i = buf -> current_line - 1; i >= 0; i--) {
-    char * line_content = buf -> lines[i].content;
-    int offset = 0;
-    int last_match_offset = -1;
-    while (regexec( & regex, line_content + offset, 1, pmatch, 0) == 0) {
-      if (buf -> lines[i].matches.count >= buf -> lines[i].matches.capacity) {
-        int new_capacity = buf -> lines[i].matches.capacity == 0 ? 4 : buf -> lines[i].matches.capacity * 2;
-        SearchMatch * new_matches = realloc(buf -> lines[i].matches.matches, new_capacity * sizeof(SearchMatch));
-        if (!new_matches) break;
-        buf -> lines[i].matches.matches = new_matches;
-        buf -> lines[i].matches.capacity = new_capacity;
-      }
-      SearchMatch match = {
-        .start = offset + pmatch[0].rm_so,
-        .end = offset + pmatch[0].rm_eo
-      };
-      buf -> lines[i].matches.matches[buf -> lines[i].matches.count++] = match;
-      last_match_offset = offset;
-      if (!found) {
-        found = true;
-        last_match_line = i;
-      }
-      offset += pmatch[0].rm_eo;
-      if (pmatch[0].rm_so == pmatch[0].rm_eo) break;
-    }
-  }
-  if (!found) {
-    for (int i = buf -> count - 1; i >= buf -> current_line; i--) {
-      char * line_content = buf -> lines[i].content;
-      int offset = 0;
-      int last_match_offset = -1;
-      while (regexec( & regex, line_content + offset, 1, pmatch, 0) == 0) {
-        if (buf -> lines[i].matches.count >= buf -> lines[i].matches.capacity) {
-          int new_capacity = buf -> lines[i].matches.capacity == 0 ? 4 : buf -> lines[i].matches.capacity * 2;
-          SearchMatch * new_matches = realloc(buf -> lines[i].matches.matches, new_capacity * sizeof(SearchMatch));
-          if (!new_matches) break;
-          buf -> lines[i].matches.matches = new_matches;
-          buf -> lines[i].matches.capacity = new_capacity;
-        }
-        SearchMatch match = {
-          .start = offset + pmatch[0].rm_so,
-          .end = offset + pmatch[0].rm_eo
-        };
-        buf -> lines[i].matches.matches[buf -> lines[i].matches.count++] = match;
-        last_match_offset = offset;
-        if (!found) {
-          found = true;
-          last_match_line = i;
-        }
-        offset += pmatch[0].rm_eo;
-        if (pmatch[0].rm_so == pmatch[0].rm_eo) break;
-      }
-    }
-  }
-  regfree( & regex);
-  if (found) {
-    buf -> current_line = last_match_line;
-    buf -> screen_line = 0;
-    for (int j = 0; j < last_match_line; j++) {
-      buf -> screen_line += buf -> lines[j].wrapped_lines;
-    }
-  }
+  // A pattern that does not compile yet keeps the last result on screen
+  if (buffer_search_start(buf, ed -> search_buffer, 1, ed -> search_origin) < 0) return;
+  ed -> search_pending = 1;
+  search_poll(ed);
 }
 void process_command(Editor * ed) {
   Buffer * buf = current_buffer(ed);
   if (!buf) return;
   if (strcmp(ed -> command_buffer, "q") == 0) {
     if (ed -> num_buffers > 1) {
+      buffer_destroy(buf);
+      // The next buffer's line table may reuse the address of this one's
+      ed -> drawn_lines = NULL;
       for (int i = ed -> current_buffer; i < ed -> num_buffers - 1; i++) {
         ed -> buffers[i] = ed -> buffers[i + 1];
       }
@@ -378,30 +258,22 @@ void process_command(Editor * ed) {
   } else if (strcmp(ed -> command_buffer, "n") == 0) {
     if (ed -> current_buffer < ed -> num_buffers - 1) {
       ed -> current_buffer++;
-      clear();
-      refresh();
     }
   } else if (strcmp(ed -> command_buffer, "p") == 0) {
     if (ed -> current_buffer > 0) {
       ed -> current_buffer--;
-      clear();
-      refresh();
     }
   } else if (strcmp(ed -> command_buffer, "l") == 0) {
     buf -> show_line_numbers = !buf -> show_line_numbers;
-    clear();
-    display_lines(ed);
+  } else if (strcmp(ed -> command_buffer, "chop") == 0) {
+    buffer_set_chop(buf, !buf -> chop_lines);
   } else if (strncmp(ed -> command_buffer, "j", 1) == 0) {
     int line_number = 0;
     if (sscanf(ed -> command_buffer + 1, "%d", & line_number) == 1) {
+      buffer_wait_lines(buf, line_number);
       if (line_number > 0 && line_number <= buf -> count) {
         buf -> current_line = line_number - 1;
-        buf -> screen_line = 0;
-        for (int j = 0; j < buf -> current_line; j++) {
-          buf -> screen_line += buf -> lines[j].wrapped_lines;
-        }
-        clear();
-        refresh();
+        buf -> screen_line = wrap_tree_prefix(buf, buf -> current_line);
       } else {
         mvprintw(LINES - 1, 0, "Invalid line number");
         clrtoeol();
@@ -414,8 +286,29 @@ void process_command(Editor * ed) {
       refresh();
       napms(1000);
     }
+  } else if (strncmp(ed -> command_buffer, "m", 1) == 0) {
+    int match_number = 0;
+    if (sscanf(ed -> command_buffer + 1, "%d", & match_number) == 1) {
+      int line = buffer_match_line(buf, match_number - 1);
+      if (line >= 0) {
+        buf -> current_line = line;
+        buf -> screen_line = wrap_tree_prefix(buf, line);
+      } else {
+        mvprintw(LINES - 1, 0, "Invalid match number");
+        clrtoeol();
+        refresh();
+        napms(1000);
+      }
+    } else {
+      mvprintw(LINES - 1, 0, "Invalid command: m requires a match number");
+      clrtoeol();
+      refresh();
+      napms(1000);
+    }
   } else if (strncmp(ed -> command_buffer, "s/", 2) == 0) {
     ed -> search_mode = 1;
+    ed -> search_origin = buf -> current_line;
+    ed -> search_origin_screen = buf -> screen_line;
     strncpy(ed -> search_buffer, ed -> command_buffer + 2, SEARCH_BUFFER_SIZE - 1);
     ed -> search_buffer[SEARCH_BUFFER_SIZE - 1] = '\0';
     if (!search_forward(ed, ed -> search_buffer)) {
@@ -423,9 +316,6 @@ void process_command(Editor * ed) {
       clrtoeol();
       refresh();
       napms(1000);
-    } else {
-      clear();
-      refresh();
     }
   } else {
     mvprintw(LINES - 1, 0, "Invalid command");
@@ -457,22 +347,38 @@ int handle_input(Editor * ed, int ch) {
     }
   } else if (ed -> search_mode) {
     if (ch == '\n') {
-      search_forward(ed, ed -> search_buffer);
+      if (buf -> search && strcmp(buf -> search -> pattern, ed -> search_buffer) == 0) {
+        // Already running from the origin: only wait for its nearest match
+        buffer_search_nearest(buf, 1);
+        search_poll(ed);
+      } else {
+        search_restore_origin(ed);
+        search_forward(ed, ed -> search_buffer);
+      }
       ed -> search_mode = 0;
     } else if (ch == 27) {
+      buffer_cancel_search(buf);
+      search_restore_origin(ed);
+      ed -> search_pending = 0;
       ed -> search_mode = 0;
       ed -> search_buffer[0] = '\0';
     } else if (ch == KEY_BACKSPACE || ch == 127) {
       int len = strlen(ed -> search_buffer);
-      if (len > 0) ed -> search_buffer[len - 1] = '\0';
+      if (len > 0) {
+        ed -> search_buffer[len - 1] = '\0';
+        search_incremental(ed);
+      }
     } else if (isprint(ch)) {
       int len = strlen(ed -> search_buffer);
       if (len < SEARCH_BUFFER_SIZE - 1) {
         ed -> search_buffer[len] = ch;
         ed -> search_buffer[len + 1] = '\0';
+        search_incremental(ed);
       }
     }
   } else {
+    // Any other key lets the view go from the end of a file still indexing
+    buf -> pin_end = 0;
     switch (ch) {
     case ':':
       ed -> command_mode = 1;
@@ -481,19 +387,18 @@ int handle_input(Editor * ed, int ch) {
     case '/':
       ed -> search_mode = 1;
       ed -> search_buffer[0] = '\0';
+      ed -> search_origin = buf -> current_line;
+      ed -> search_origin_screen = buf -> screen_line;
       break;
     case 'n':
-      if (strlen(ed -> search_buffer) > 0) {
-        search_forward(ed, ed -> search_buffer);
-      }
+      search_step(ed, 1);
       break;
     case 'p':
-      if (strlen(ed -> search_buffer) > 0) {
-        search_backward(ed, ed -> search_buffer);
-      }
+      search_step(ed, -1);
       break;
     case KEY_DOWN:
       buf -> screen_line++;
+      buffer_wait_screen_line(buf, buf -> screen_line + LINES - 3);
       int file_line, wrap_index;
       screen_to_file_position(ed, buf -> screen_line, & file_line, & wrap_index);
       buf -> current_line = file_line;
@@ -506,9 +411,24 @@ int handle_input(Editor * ed, int ch) {
         buf -> current_line = file_line;
       }
       break;
+    case KEY_RIGHT:
+    case KEY_LEFT:
+      if (buf -> chop_lines) {
+        // Half a screen at a time, kept on tab stops so tabs line up
+        int step = buffer_text_width(buf) / 2 / TAB_SIZE * TAB_SIZE;
+        if (step < TAB_SIZE) step = TAB_SIZE;
+        buf -> left_column += ch == KEY_RIGHT ? step : -step;
+        // No further than shows the end of the widest line on screen
+        int widest = buffer_view_width(buf) - buffer_text_width(buf);
+        int limit = widest > 0 ? (widest + step - 1) / step * step : 0;
+        if (buf -> left_column > limit) buf -> left_column = limit;
+        if (buf -> left_column < 0) buf -> left_column = 0;
+      }
+      break;
     case ' ': {
       int page_size = LINES - 3;
       buf -> screen_line += page_size;
+      buffer_wait_screen_line(buf, buf -> screen_line + page_size);
       int file_line, wrap_index;
       screen_to_file_position(ed, buf -> screen_line, & file_line, & wrap_index);
       buf -> current_line = file_line;
@@ -526,6 +446,18 @@ int handle_input(Editor * ed, int ch) {
       buf -> current_line = file_line;
     }
     break;
+    case 'F':
+      if (buf -> follow_fd >= 0) {
+        follow_stop(buf);
+      } else if (follow_start(buf) < 0) {
+        mvprintw(LINES - 1, 0, "Cannot follow %s", buf -> filename);
+        clrtoeol();
+        refresh();
+        napms(1000);
+      } else {
+        buf -> pin_end = 1;
+      }
+      break;
     case 'q':
       return -1;
     case ']':
@@ -540,30 +472,119 @@ int handle_input(Editor * ed, int ch) {
   }
   return 0;
 }
+static long map_page_size = 4096;
+// Every file mapping, for the SIGBUS handler. Only the main thread adds and
+// removes entries, and an entry's start is stored last, so the handler sees
+// either a whole entry or none without touching the editor's buffers.
+typedef struct {
+  char * start; // NULL for a free entry
+  size_t size;
+  volatile sig_atomic_t stale; // the file shrank under the mapping
+} MapRange;
+static MapRange map_ranges[MAX_BUFFERS];
+int map_register(char * map, size_t size) {
+  for (int i = 0; i < MAX_BUFFERS; i++) {
+    if (__atomic_load_n( & map_ranges[i].start, __ATOMIC_RELAXED)) continue;
+    map_ranges[i].size = size;
+    map_ranges[i].stale = 0;
+    __atomic_store_n( & map_ranges[i].start, map, __ATOMIC_RELEASE);
+    return i;
+  }
+  return -1;
+}
+// Unmaps the buffer's file after taking it out of the handler's table
+void buffer_unmap(Buffer * buf) {
+  if (!buf -> map) return;
+  if (buf -> map_slot >= 0) __atomic_store_n( & map_ranges[buf -> map_slot].start, NULL, __ATOMIC_RELEASE);
+  munmap(buf -> map, buf -> map_size);
+  buf -> map = NULL;
+  buf -> map_size = 0;
+  buf -> map_slot = -1;
+}
+int buffer_map_stale(const Buffer * buf) {
+  return buf -> map_slot >= 0 && map_ranges[buf -> map_slot].stale;
+}
+// A mapped file that shrinks under the viewer raises SIGBUS on the first
+// access past its new end, in whichever thread made it. Zero pages are
+// mapped over the rest of the mapping so that access completes, and the
+// entry is flagged for the main loop to load the file again as it is now.
+void handle_map_fault(int sig, siginfo_t * info, void * context) {
+  (void) context;
+  char * addr = info -> si_addr;
+  for (int i = 0; i < MAX_BUFFERS; i++) {
+    MapRange * range = & map_ranges[i];
+    char * start = __atomic_load_n( & range -> start, __ATOMIC_ACQUIRE);
+    if (!start || addr < start || addr >= start + range -> size) continue;
+    char * page = start + (addr - start) / map_page_size * map_page_size;
+    mmap(page, start + range -> size - page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    range -> stale = 1;
+    event_signal();
+    return;
+  }
+  // Not a mapped file: fault again without the handler
+  signal(sig, SIG_DFL);
+}
+// Loads a buffer again from the start of the file open on fd, for when the
+// file shrank under it
+int buffer_reload(Buffer * buf, int fd) {
+  int trigrams = buf -> trigrams != NULL;
+  buffer_clear(buf);
+  lseek(fd, 0, SEEK_SET);
+  if (buffer_load(buf, fd) < 0) return -1;
+  if (trigrams) trigram_start(buf);
+  return 0;
+}
+void buffer_reload_stale(Buffer * buf) {
+  int fd = open(buf -> filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    buffer_clear(buf);
+    return;
+  }
+  buffer_reload(buf, fd);
+  close(fd);
+}
+int map_file(Buffer * buf, int fd, size_t size) {
+  map_page_size = sysconf(_SC_PAGESIZE);
+  char * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) return -1;
+  buf -> map = map;
+  buf -> map_size = size;
+  buf -> map_slot = map_register(map, size);
+  madvise(map, size, MADV_SEQUENTIAL);
+  // Index in the background; only the first screenful is waited for
+  if (indexer_start(buf, map, size) < 0) return -1;
+  buffer_wait_lines(buf, INDEX_PRIME_LINES);
+  return 0;
+}
+// Loads the file open on fd: regular files are mapped and indexed in place,
+// pipes and devices are copied
+int buffer_load(Buffer * buf, int fd) {
+  struct stat st;
+  if (fstat(fd, & st) == 0 && S_ISREG(st.st_mode)) {
+    buf -> file_offset = st.st_size;
+    int ret = st.st_size > 0 ? map_file(buf, fd, st.st_size) : 0;
+    if (ret == 0 || buf -> map) return ret;
+  }
+  if (buffer_read_fd(buf, fd) < 0) return -1;
+  if (buf -> file_offset >= 0) buf -> file_offset = lseek(fd, 0, SEEK_CUR);
+  return 0;
+}
 int load_file(Editor * ed,
   const char * fname) {
   Buffer * buf = editor_new_buffer(ed);
   if (!buf) return -1;
   FILE * file = fopen(fname, "r");
-  if (!file) {
-    ed -> num_buffers--;
-    return -1;
-  }
-  buf -> filename = strdup(fname);
-  if (!buf -> filename) {
-    fclose(file);
+  buf -> filename = file ? strdup(fname) : NULL;
+  int ret = buf -> filename ? buffer_load(buf, fileno(file)) : -1;
+  if (file) fclose(file);
+  if (ret < 0) {
+    // The failed buffer was the last one added, so nothing shifts
+    int saved = errno;
+    buffer_destroy(buf);
     ed -> num_buffers--;
-    return -1;
+    errno = saved;
   }
-  char buffer[MAX_LINE_LENGTH];
-  while (fgets(buffer, sizeof(buffer), file)) {
-    if (editor_append_line(buf, buffer, strlen(buffer)) < 0) {
-      fclose(file);
-      return -1;
-    }
-  }
-  fclose(file);
-  return 0;
+  return ret;
 }
 void print_help(const char * prog_name) {
   printf("Usage: %s [OPTIONS] [PIPE_INPUT] | [FILE...]\n", prog_name);
@@ -571,6 +592,9 @@ void print_help(const char * prog_name) {
   printf("\nOptions:\n");
   printf(" -h, --help Show this help message and exit.\n");
   printf(" -v, --version Display the version information and exit.\n");
+  printf(" -F, --follow Keep reading files as they grow, like 'tail -f' (toggle with 'F').\n");
+  printf(" -T, --trigrams Index files for faster repeated searches, cached under ~/.cache/least.\n");
+  printf(" -S, --chop-long-lines Show each line on one row, scrolled sideways with the arrow keys (toggle with ':chop').\n");
   printf("\nArguments:\n");
   printf(" PIPE_INPUT Input provided through a pipe (supports multiple piped inputs).\n");
   printf(" FILE... One or more files to open and edit (provided after the program name).\n");
@@ -615,6 +639,11 @@ char * get_running_command() {
   return cmd;
 }
 int main(int argc, char *argv[]) {
+    int follow_files = 0;
+    int trigram_files = 0;
+    int chop_lines = 0;
+    // Options are taken out of argv so only files or commands are left
+    int args = 1;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             print_help(argv[0]);
@@ -624,16 +653,43 @@ int main(int argc, char *argv[]) {
             print_version();
             return 0;
         }
+        if (strcmp(argv[i], "--follow") == 0 || strcmp(argv[i], "-F") == 0) {
+            follow_files = 1;
+        } else if (strcmp(argv[i], "--trigrams") == 0 || strcmp(argv[i], "-T") == 0) {
+            trigram_files = 1;
+        } else if (strcmp(argv[i], "--chop-long-lines") == 0 || strcmp(argv[i], "-S") == 0) {
+            chop_lines = 1;
+        } else {
+            argv[args++] = argv[i];
+        }
     }
+    argc = args;
+    argv[argc] = NULL;
     Editor *ed = editor_create();
     if (!ed) {
         fprintf(stderr, "Failed to initialize editor\n");
         return 1;
     }
     GLOBAL_EDITOR = ed;
+    // Set before any buffer exists so pipe buffers opened later chop too
+    ed->chop_lines = chop_lines;
     signal(SIGINT, SIG_IGN);
     signal(SIGTERM, SIG_IGN);
-    signal(SIGWINCH, handle_resize);
+    if (event_init() < 0) {
+        fprintf(stderr, "Failed to initialize event loop\n");
+        editor_destroy(ed);
+        return 1;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_resize;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+    sa.sa_handler = NULL;
+    sa.sa_sigaction = handle_map_fault;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGBUS, &sa, NULL);
     int need_reopen_tty = 0;
     int buffers_created = 0;
     if (argc >= 3 && (strcmp(argv[1], "--multi") == 0 || strcmp(argv[1], "-m") == 0)) {
@@ -656,17 +712,11 @@ int main(int argc, char *argv[]) {
                 pclose(pipe);
                 continue;
             }
-            char line[MAX_LINE_LENGTH];
-            int line_count = 0;
-            while (fgets(line, sizeof(line), pipe)) {
-                if (editor_append_line(cmd_buf, line, strlen(line)) < 0) {
-                    fprintf(stderr, "Failed to process command output: %s\n", argv[i]);
-                    break;
-                }
-                line_count++;
+            if (buffer_read_fd(cmd_buf, fileno(pipe)) < 0) {
+                fprintf(stderr, "Failed to process command output: %s\n", argv[i]);
             }
             pclose(pipe);
-            if (line_count == 0) {
+            if (cmd_buf->count == 0) {
                 free(cmd_buf->filename);
                 ed->num_buffers--;
                 fprintf(stderr, "Command produced no output: %s\n", argv[i]);
@@ -681,117 +731,14 @@ int main(int argc, char *argv[]) {
         }
     } else {
         if (!isatty(STDIN_FILENO)) {
-            need_reopen_tty = 1;
-            Buffer *pipe_buf = NULL;
-            char pipe_name[32];
-            int pipe_count = 0;
-            size_t line_pos = 0;
-            int has_content = 0;
-            char *line_buffer = malloc(MAX_LINE_LENGTH * 2);
-            if (!line_buffer) {
-                fprintf(stderr, "Failed to allocate memory for input buffer\n");
+            // The pipe is read as it streams in, on a descriptor of its own
+            // since stdin is about to become the terminal
+            if (stream_open(STDIN_FILENO) < 0) {
+                fprintf(stderr, "Failed to read pipe input\n");
                 editor_destroy(ed);
                 return 1;
             }
-            int ch;
-            while ((ch = fgetc(stdin)) != EOF) {
-                if (ch == '\0') {
-                    if (line_pos > 0) {
-                        line_buffer[line_pos] = '\0';
-                        if (pipe_buf && editor_append_line(pipe_buf, line_buffer, line_pos) < 0) {
-                            fprintf(stderr, "Failed to process pipe input\n");
-                            break;
-                        }
-                        line_pos = 0;
-                        has_content = 1;
-                    }
-                    if (!pipe_buf || has_content) {
-                        if (pipe_buf) {
-                            buffers_created++;
-                        }
-                        pipe_buf = editor_new_buffer(ed);
-                        if (!pipe_buf) {
-                            fprintf(stderr, "Failed to create buffer for pipe input\n");
-                            free(line_buffer);
-                            editor_destroy(ed);
-                            return 1;
-                        }
-                        snprintf(pipe_name, sizeof(pipe_name), "pipe-%d", ++pipe_count);
-                        pipe_buf->filename = strdup(pipe_name);
-                        if (!pipe_buf->filename) {
-                            fprintf(stderr, "Failed to allocate memory for pipe name\n");
-                            ed->num_buffers--; 
-                            free(line_buffer);
-                            editor_destroy(ed);
-                            return 1;
-                        }
-                        has_content = 0;
-                    }
-                    continue;
-                }
-                line_buffer[line_pos++] = ch;
-                if (ch == '\n' || line_pos >= MAX_LINE_LENGTH - 1) {
-                    line_buffer[line_pos] = '\0';
-                    if (!pipe_buf) {
-                        pipe_buf = editor_new_buffer(ed);
-                        if (!pipe_buf) {
-                            fprintf(stderr, "Failed to create buffer for pipe input\n");
-                            free(line_buffer);
-                            editor_destroy(ed);
-                            return 1;
-                        }
-                        snprintf(pipe_name, sizeof(pipe_name), "pipe-%d", ++pipe_count);
-                        pipe_buf->filename = strdup(pipe_name);
-                        if (!pipe_buf->filename) {
-                            fprintf(stderr, "Failed to allocate memory for pipe name\n");
-                            ed->num_buffers--; 
-                            free(line_buffer);
-                            editor_destroy(ed);
-                            return 1;
-                        }
-                    }
-                    if (editor_append_line(pipe_buf, line_buffer, line_pos) < 0) {
-                        fprintf(stderr, "Failed to process pipe input\n");
-                        free(line_buffer);
-                        editor_destroy(ed);
-                        return 1;
-                    }
-                    has_content = 1;
-                    line_pos = 0;
-                }
-            }
-            if (line_pos > 0) {
-                line_buffer[line_pos] = '\0';
-                if (!pipe_buf) {
-                    pipe_buf = editor_new_buffer(ed);
-                    if (!pipe_buf) {
-                        fprintf(stderr, "Failed to create buffer for pipe input\n");
-                        free(line_buffer);
-                        editor_destroy(ed);
-                        return 1;
-                    }
-                    snprintf(pipe_name, sizeof(pipe_name), "pipe-%d", ++pipe_count);
-                    pipe_buf->filename = strdup(pipe_name);
-                    if (!pipe_buf->filename) {
-                        fprintf(stderr, "Failed to allocate memory for pipe name\n");
-                        ed->num_buffers--; 
-                        free(line_buffer);
-                        editor_destroy(ed);
-                        return 1;
-                    }
-                }
-                if (editor_append_line(pipe_buf, line_buffer, line_pos) < 0) {
-                    fprintf(stderr, "Failed to process pipe input\n");
-                    free(line_buffer);
-                    editor_destroy(ed);
-                    return 1;
-                }
-                has_content = 1;
-            }
-            free(line_buffer);
-            if (has_content) {
-                buffers_created++;
-            }
+            need_reopen_tty = 1;
         }
         if (need_reopen_tty) {
             if (freopen("/dev/tty", "r", stdin) == NULL) {
@@ -807,6 +754,8 @@ int main(int argc, char *argv[]) {
                 buffers_created++;
             }
         }
+        stream_prime(ed);
+        buffers_created = ed->num_buffers;
     }
     if (buffers_created == 0) {
         fprintf(stderr, "No input sources available. Usage:\n");
@@ -814,10 +763,14 @@ int main(int argc, char *argv[]) {
         editor_destroy(ed);
         return 1;
     }
+    // Multibyte text is measured and drawn in the terminal's encoding
+    setlocale(LC_CTYPE, "");
     initscr();
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
+    // Let scrolled rows move on the terminal instead of being redrawn
+    idlok(stdscr, TRUE);
     if (has_colors()) {
         start_color();
         use_default_colors();
@@ -832,15 +785,85 @@ int main(int argc, char *argv[]) {
         init_pair(9, COLOR_GREEN, COLOR_BLACK);
         init_pair(10, COLOR_BLACK, COLOR_YELLOW);
     }
+    nodelay(stdscr, TRUE);
+    pool_init();
     recalculate_wraps(ed);
-    while (1) {
+    if (follow_files) {
+        for (int i = 0; i < ed->num_buffers; i++) {
+            Buffer *b = &ed->buffers[i];
+            if (follow_start(b) == 0) b->pin_end = 1;
+        }
+    }
+    if (trigram_files) {
+        for (int i = 0; i < ed->num_buffers; i++) trigram_start(&ed->buffers[i]);
+    }
+    int redraw = 1;
+    long last_draw = 0;
+    int running = 1;
+    while (running) {
+        int indexing = 0;
+        int polling = 0;
+        int backlog = 0;
+        for (int i = 0; i < ed->num_buffers; i++) {
+            Buffer *b = &ed->buffers[i];
+            if (buffer_map_stale(b)) buffer_reload_stale(b);
+            buffer_sync(b);
+            if (b->pin_end) {
+                // Follows the indexer down the file without waiting for it,
+                // and lands on the real last line once it is done
+                buffer_scroll_to_end(b);
+                b->pin_end = b->indexer != NULL;
+                redraw = 1;
+            }
+            buffer_search_extend(b);
+            if (b->indexer) indexing = 1;
+            if (b->follow_fd >= 0) {
+                if (follow_update(b)) backlog = 1;
+                if (b->follow_watch < 0) polling = 1;
+            }
+            buffer_collect_lex(b);
+            buffer_schedule_lex(b);
+            buffer_collect_wraps(b);
+            buffer_schedule_wraps(b);
+            buffer_collect_search(b);
+        }
         Buffer *buf = current_buffer(ed);
         if (!buf) break;
-        display_lines(ed);
-        int ch = getch();
-        if (handle_input(ed, ch) < 0) break;
+        if (search_poll(ed)) redraw = 1;
+        // Sleep until a key, a signal, a watched fd or a background thread
+        // wakes us; indexers are polled so their progress keeps updating, and
+        // a follow backlog is read in slices between keys
+        int timeout = backlog ? 0 : indexing ? 100 : polling ? FOLLOW_POLL_MS : -1;
+        if (redraw || buf->dirty) {
+            // Appended text alone redraws at most every REDRAW_INTERVAL_MS
+            long since = event_now_ms() - last_draw;
+            if (redraw || since >= REDRAW_INTERVAL_MS) {
+                display_lines(ed);
+                last_draw = event_now_ms();
+            } else if (timeout < 0 || timeout > REDRAW_INTERVAL_MS - since) {
+                timeout = REDRAW_INTERVAL_MS - since;
+            }
+        }
+        int tty_ready = event_wait(ed, timeout);
+        redraw = indexing;
+        if (resize_pending) {
+            apply_resize(ed);
+            redraw = 1;
+        }
+        if (tty_ready < 0) break;
+        if (!tty_ready) continue;
+        // Handle every queued key before drawing the next frame
+        int ch;
+        while ((ch = getch()) != ERR) {
+            if (handle_input(ed, ch) < 0) {
+                running = 0;
+                break;
+            }
+            redraw = 1;
+        }
     }
     editor_destroy(ed);
+    pool_shutdown();
     endwin();
     return 0;
 }
@@ -0,0 +1,208 @@
+#include "../include/least.h"
+
+// Classifies text[pos] for the highlighter and advances state past it.
+// Delimiters are two characters, so LEX_OPENING and LEX_CLOSING carry the
+// second one over a wrap point.
+int lex_char(const char * text, int pos, int length, int * state) {
+  int s = * state;
+  char c = text[pos];
+  char next = pos + 1 < length ? text[pos + 1] : '\0';
+  if (s & LEX_LINE_COMMENT) return LEX_CLASS_COMMENT;
+  if (s & LEX_COMMENT) {
+    if (s & LEX_OPENING) s &= ~LEX_OPENING;
+    else if (s & LEX_CLOSING) s &= ~(LEX_CLOSING | LEX_COMMENT);
+    else if (c == '*' && next == '/') s |= LEX_CLOSING;
+    * state = s;
+    return LEX_CLASS_COMMENT;
+  }
+  if (s & (LEX_STRING | LEX_CHAR)) {
+    if (s & LEX_ESCAPE) s &= ~LEX_ESCAPE;
+    else if (c == '\\') s |= LEX_ESCAPE;
+    // An unescaped newline ends an unterminated literal
+    else if (c == '\n' || c == ((s & LEX_STRING) ? '"' : '\'')) s &= ~(LEX_STRING | LEX_CHAR);
+    * state = s;
+    return LEX_CLASS_STRING;
+  }
+  if (c == '/' && next == '*') {
+    * state = s | LEX_COMMENT | LEX_OPENING;
+    return LEX_CLASS_COMMENT;
+  }
+  if (c == '/' && next == '/') {
+    * state = s | LEX_LINE_COMMENT;
+    return LEX_CLASS_COMMENT;
+  }
+  if (c == '"' || c == '\'') {
+    * state = s | (c == '"' ? LEX_STRING : LEX_CHAR);
+    return LEX_CLASS_STRING;
+  }
+  return LEX_CLASS_CODE;
+}
+// The state after text[start, end) without drawing it. Runs of characters
+// that cannot change the state are skipped.
+int lex_scan(const char * text, int start, int end, int length, int state) {
+  int pos = start;
+  while (pos < end) {
+    if (state & LEX_LINE_COMMENT) break;
+    if (state == 0) {
+      while (pos < end && text[pos] != '/' && text[pos] != '"' && text[pos] != '\'') pos++;
+      if (pos == end) break;
+    } else if (state == LEX_COMMENT) {
+      const char * star = memchr(text + pos, '*', end - pos);
+      if (!star) break;
+      pos = star - text;
+    }
+    lex_char(text, pos, length, & state);
+    pos++;
+  }
+  return state;
+}
+// The state carried into the next line: block comments, and literals whose
+// newline was escaped
+int lex_line_end(int state) {
+  return state & (LEX_COMMENT | LEX_STRING | LEX_CHAR);
+}
+// The states lex_line_end() can carry into a line, by LexJob.ends slot
+static const unsigned char lex_start_states[LEX_START_STATES] = {
+  0, LEX_COMMENT, LEX_STRING, LEX_CHAR
+};
+int lex_start_slot(int state) {
+  return state == LEX_COMMENT ? 1 : state == LEX_STRING ? 2 : state == LEX_CHAR ? 3 : 0;
+}
+void lex_job_run(void * arg) {
+  LexJob * job = arg;
+  for (int s = 0; s < LEX_START_STATES; s++) {
+    int state = lex_start_states[s];
+    for (int i = job -> first; i < job -> last; i++) {
+      if (__atomic_load_n( & job -> cancel, __ATOMIC_ACQUIRE)) break;
+      const Line * line = line_table_get(job -> lines, i);
+      state = lex_line_end(lex_scan(line -> content, 0, line -> length, line -> length, state));
+    }
+    job -> ends[s] = state;
+  }
+  __atomic_store_n( & job -> done, 1, __ATOMIC_RELEASE);
+}
+// Hands every whole chunk of settled lines not yet lexed to the pool, ahead
+// of the wrap jobs since a jump waits for them
+void buffer_schedule_lex(Buffer * buf) {
+  int next = buf -> lex_chunks + buf -> lex_job_count;
+  while ((long)(next + 1) * LEX_CHUNK_LINES <= buffer_settled(buf)) {
+    if (buf -> lex_job_count == buf -> lex_job_capacity) {
+      int capacity = buf -> lex_job_capacity ? buf -> lex_job_capacity * 2 : 64;
+      LexJob ** jobs = realloc(buf -> lex_jobs, capacity * sizeof(LexJob * ));
+      if (!jobs) return;
+      buf -> lex_jobs = jobs;
+      buf -> lex_job_capacity = capacity;
+    }
+    LexJob * job = calloc(1, sizeof(LexJob));
+    if (!job) return;
+    job -> lines = buf -> lines;
+    job -> first = next * LEX_CHUNK_LINES;
+    job -> last = job -> first + LEX_CHUNK_LINES;
+    buf -> lex_jobs[buf -> lex_job_count++] = job;
+    if (pool_submit_first(lex_job_run, job) < 0) lex_job_run(job);
+    next++;
+  }
+}
+// Chains the results of the jobs that have finished, in chunk order, into
+// checkpoints. With wait set, waits for the jobs up to chunk.
+void lex_collect(Buffer * buf, int wait, int chunk) {
+  int folded = 0;
+  while (folded < buf -> lex_job_count) {
+    LexJob * job = buf -> lex_jobs[folded];
+    if (wait && buf -> lex_chunks < chunk) pool_wait( & job -> done);
+    if (!__atomic_load_n( & job -> done, __ATOMIC_ACQUIRE)) break;
+    if (buf -> lex_chunks + 1 >= buf -> lex_marks_capacity) {
+      int capacity = buf -> lex_marks_capacity ? buf -> lex_marks_capacity * 2 : 64;
+      unsigned char * marks = realloc(buf -> lex_marks, capacity);
+      if (!marks) break;
+      if (!buf -> lex_marks) marks[0] = 0;
+      buf -> lex_marks = marks;
+      buf -> lex_marks_capacity = capacity;
+    }
+    int start = buf -> lex_marks[buf -> lex_chunks];
+    buf -> lex_marks[buf -> lex_chunks + 1] = job -> ends[lex_start_slot(start)];
+    buf -> lex_chunks++;
+    free(job);
+    folded++;
+  }
+  buf -> lex_job_count -= folded;
+  memmove(buf -> lex_jobs, buf -> lex_jobs + folded, buf -> lex_job_count * sizeof(LexJob * ));
+}
+void buffer_collect_lex(Buffer * buf) {
+  lex_collect(buf, 0, 0);
+}
+// Drops the jobs from position keep on, once none of them is running
+void lex_drop_jobs(Buffer * buf, int keep) {
+  for (int j = keep; j < buf -> lex_job_count; j++) {
+    __atomic_store_n( & buf -> lex_jobs[j] -> cancel, 1, __ATOMIC_RELEASE);
+  }
+  for (int j = keep; j < buf -> lex_job_count; j++) {
+    pool_wait( & buf -> lex_jobs[j] -> done);
+    free(buf -> lex_jobs[j]);
+  }
+  if (buf -> lex_job_count > keep) buf -> lex_job_count = keep;
+}
+// Forgets every state, for when the buffer's lines are dropped
+void buffer_cancel_lex(Buffer * buf) {
+  lex_drop_jobs(buf, 0);
+  free(buf -> lex_jobs);
+  free(buf -> lex_marks);
+  buf -> lex_jobs = NULL;
+  buf -> lex_job_count = 0;
+  buf -> lex_job_capacity = 0;
+  buf -> lex_marks = NULL;
+  buf -> lex_marks_capacity = 0;
+  buf -> lex_chunks = 0;
+  buf -> lex_first = 0;
+  buf -> lex_valid = 0;
+}
+// Line index is about to change, so the states after it may too. Jobs that
+// read it are waited for and dropped along with the checkpoints they gave.
+void buffer_lex_changed(Buffer * buf, int index) {
+  if (buf -> lex_valid > index + 1) buf -> lex_valid = index + 1;
+  if (buf -> lex_valid <= buf -> lex_first) buf -> lex_first = buf -> lex_valid = 0;
+  int chunk = index / LEX_CHUNK_LINES;
+  if (chunk >= buf -> lex_chunks + buf -> lex_job_count) return;
+  if (chunk < buf -> lex_chunks) {
+    lex_drop_jobs(buf, 0);
+    buf -> lex_chunks = chunk;
+  } else {
+    lex_drop_jobs(buf, chunk - buf -> lex_chunks);
+  }
+}
+// The state at the first line of chunk, which the chunks before it decide
+int lex_checkpoint(Buffer * buf, int chunk) {
+  if (chunk == 0) return 0;
+  if (chunk > buf -> lex_chunks) {
+    buffer_schedule_lex(buf);
+    lex_collect(buf, 1, chunk);
+  }
+  if (chunk <= buf -> lex_chunks) return buf -> lex_marks[chunk];
+  // Without room for checkpoints, lex from the last one there is
+  int line = buf -> lex_chunks * LEX_CHUNK_LINES;
+  int state = buf -> lex_chunks > 0 ? buf -> lex_marks[buf -> lex_chunks] : 0;
+  for (; line < chunk * LEX_CHUNK_LINES; line++) {
+    const Line * prev = buffer_line(buf, line);
+    state = lex_line_end(lex_scan(prev -> content, 0, prev -> length, prev -> length, state));
+  }
+  return state;
+}
+// The lexer state at the start of a line. Lines are lexed from the nearer
+// of the cached run and their chunk's checkpoint, so a jump anywhere lexes
+// fewer than LEX_CHUNK_LINES lines, and scrolling only the new ones.
+int buffer_lex_state(Buffer * buf, int index) {
+  if (index >= buf -> lex_first && index < buf -> lex_valid) return buffer_line(buf, index) -> lex_state;
+  int first = index / LEX_CHUNK_LINES * LEX_CHUNK_LINES;
+  if (index < buf -> lex_first || buf -> lex_valid <= buf -> lex_first || buf -> lex_valid < first) {
+    buffer_line(buf, first) -> lex_state = lex_checkpoint(buf, first / LEX_CHUNK_LINES);
+    buf -> lex_first = first;
+    buf -> lex_valid = first + 1;
+  }
+  while (buf -> lex_valid <= index) {
+    Line * prev = buffer_line(buf, buf -> lex_valid - 1);
+    int state = lex_scan(prev -> content, 0, prev -> length, prev -> length, prev -> lex_state);
+    buffer_line(buf, buf -> lex_valid) -> lex_state = lex_line_end(state);
+    buf -> lex_valid++;
+  }
+  return buffer_line(buf, index) -> lex_state;
+}
@@ -0,0 +1,105 @@
+#include "../include/least.h"
+
+typedef struct PoolTask {
+  void( * run)(void * arg);
+  void * arg;
+  struct PoolTask * next;
+} PoolTask;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+static PoolTask * pool_head = NULL;
+static PoolTask * pool_tail = NULL;
+static PoolTask * pool_urgent = NULL; // last task queued by pool_submit_first
+static pthread_t pool_threads[POOL_MAX_THREADS];
+static int pool_size = 0;
+static int pool_stopping = 0;
+
+void * pool_worker(void * arg) {
+  (void) arg;
+  pthread_mutex_lock( & pool_lock);
+  while (1) {
+    while (!pool_head && !pool_stopping) pthread_cond_wait( & pool_work, & pool_lock);
+    if (!pool_head) break;
+    PoolTask * task = pool_head;
+    pool_head = task -> next;
+    if (!pool_head) pool_tail = NULL;
+    if (task == pool_urgent) pool_urgent = NULL;
+    pthread_mutex_unlock( & pool_lock);
+    task -> run(task -> arg);
+    free(task);
+    pthread_mutex_lock( & pool_lock);
+    pthread_cond_broadcast( & pool_idle);
+  }
+  pthread_mutex_unlock( & pool_lock);
+  return NULL;
+}
+int pool_init(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int threads = cpus < 1 ? 1 : cpus > POOL_MAX_THREADS ? POOL_MAX_THREADS : (int) cpus;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create( & pool_threads[pool_size], NULL, pool_worker, NULL) != 0) break;
+    pool_size++;
+  }
+  return pool_size > 0 ? 0 : -1;
+}
+int pool_threads_count(void) {
+  return pool_size;
+}
+// Queues run(arg) behind every task, or with urgent set behind only the
+// other urgent ones
+int pool_queue(void( * run)(void * arg), void * arg, int urgent) {
+  PoolTask * task = malloc(sizeof(PoolTask));
+  if (!task) return -1;
+  task -> run = run;
+  task -> arg = arg;
+  task -> next = NULL;
+  pthread_mutex_lock( & pool_lock);
+  if (pool_size == 0) {
+    // No workers (pool_init failed or never called): run inline
+    pthread_mutex_unlock( & pool_lock);
+    run(arg);
+    free(task);
+    return 0;
+  }
+  if (urgent) {
+    PoolTask ** link = pool_urgent ? & pool_urgent -> next : & pool_head;
+    task -> next = * link;
+    * link = task;
+    if (!task -> next) pool_tail = task;
+    pool_urgent = task;
+  } else {
+    if (pool_tail) pool_tail -> next = task;
+    else pool_head = task;
+    pool_tail = task;
+  }
+  pthread_cond_signal( & pool_work);
+  pthread_mutex_unlock( & pool_lock);
+  return 0;
+}
+int pool_submit(void( * run)(void * arg), void * arg) {
+  return pool_queue(run, arg, 0);
+}
+// For work the user is waiting on: runs before anything pool_submit queued
+int pool_submit_first(void( * run)(void * arg), void * arg) {
+  return pool_queue(run, arg, 1);
+}
+void pool_wait(const int * done) {
+  pthread_mutex_lock( & pool_lock);
+  while (!__atomic_load_n(done, __ATOMIC_ACQUIRE)) pthread_cond_wait( & pool_idle, & pool_lock);
+  pthread_mutex_unlock( & pool_lock);
+}
+void pool_wait_zero(const int * count) {
+  pthread_mutex_lock( & pool_lock);
+  while (__atomic_load_n(count, __ATOMIC_ACQUIRE) > 0) pthread_cond_wait( & pool_idle, & pool_lock);
+  pthread_mutex_unlock( & pool_lock);
+}
+void pool_shutdown(void) {
+  pthread_mutex_lock( & pool_lock);
+  pool_stopping = 1;
+  pthread_cond_broadcast( & pool_work);
+  pthread_mutex_unlock( & pool_lock);
+  for (int i = 0; i < pool_size; i++) pthread_join(pool_threads[i], NULL);
+  pool_size = 0;
+}
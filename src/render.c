@@ -0,0 +1,77 @@
+#include "../include/least.h"
+
+int render_push(RenderLine * render, int start, int end, attr_t attr) {
+  if (render -> count > 0) {
+    CellRun * last = & render -> runs[render -> count - 1];
+    if (last -> end == start && last -> attr == attr) {
+      last -> end = end;
+      return 0;
+    }
+  }
+  if (render -> count == render -> capacity) {
+    int capacity = render -> capacity ? render -> capacity * 2 : 64;
+    CellRun * runs = realloc(render -> runs, capacity * sizeof(CellRun));
+    if (!runs) return -1;
+    render -> runs = runs;
+    render -> capacity = capacity;
+  }
+  render -> runs[render -> count++] = (CellRun) {
+    start, end, attr
+  };
+  return 0;
+}
+// Adds bytes [start, end) drawn with attr, except where a search match
+// covers them. Calls must come in line order.
+void render_add(RenderLine * render, const SearchMatch * matches, int match_count, int start, int end, attr_t attr) {
+  while (start < end) {
+    while (render -> match_cursor < match_count && matches[render -> match_cursor].end <= start) render -> match_cursor++;
+    int stop = end;
+    attr_t run_attr = attr;
+    if (render -> match_cursor < match_count) {
+      const SearchMatch * match = & matches[render -> match_cursor];
+      if (match -> start <= start) {
+        run_attr = COLOR_PAIR(10);
+        if (match -> end < stop) stop = match -> end;
+      } else if (match -> start < stop) {
+        stop = match -> start;
+      }
+    }
+    if (render_push(render, start, stop, run_attr) < 0) return;
+    start = stop;
+  }
+}
+// The runs of a line, built at least up to byte limit. Runs only depend on
+// the text, so a rewrap reuses them and only splits them differently.
+const RenderLine * buffer_line_runs(Buffer * buf, int index, int limit) {
+  if (!buf -> render_cache) {
+    buf -> render_cache = calloc(RENDER_CACHE_LINES, sizeof(RenderLine));
+    if (!buf -> render_cache) return NULL;
+    for (int i = 0; i < RENDER_CACHE_LINES; i++) buf -> render_cache[i].line = -1;
+  }
+  RenderLine * render = & buf -> render_cache[index & (RENDER_CACHE_LINES - 1)];
+  Line * line = buffer_line(buf, index);
+  int state = buffer_lex_state(buf, index);
+  if (render -> line != index || render -> length != line -> length || render -> start_state != state || render -> match_gen != buf -> match_gen) {
+    render -> line = index;
+    render -> length = line -> length;
+    render -> start_state = state;
+    render -> match_gen = buf -> match_gen;
+    render -> count = 0;
+    render -> built = 0;
+    render -> state = state;
+    render -> match_cursor = 0;
+  }
+  if (limit > line -> length) limit = line -> length;
+  if (render -> built < limit) {
+    int match_count;
+    const SearchMatch * matches = buffer_line_matches(buf, index, & match_count);
+    highlight_syntax(line, render, matches, match_count, limit);
+  }
+  return render;
+}
+void render_cache_free(Buffer * buf) {
+  if (!buf -> render_cache) return;
+  for (int i = 0; i < RENDER_CACHE_LINES; i++) free(buf -> render_cache[i].runs);
+  free(buf -> render_cache);
+  buf -> render_cache = NULL;
+}
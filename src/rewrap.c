@@ -0,0 +1,124 @@
+#include "../include/least.h"
+
+// Claims a stale line for wrapping. Lines are claimed by swapping their
+// wrap_gen to WRAP_BUSY so a worker and the main thread never wrap the same
+// line at once; returns 0 if the line is already wrapped for gen.
+int line_claim_wrap(Line * line, int gen) {
+  int line_gen = __atomic_load_n( & line -> wrap_gen, __ATOMIC_ACQUIRE);
+  while (line_gen != gen) {
+    if (line_gen == WRAP_BUSY) {
+      sched_yield();
+      line_gen = __atomic_load_n( & line -> wrap_gen, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    if (__atomic_compare_exchange_n( & line -> wrap_gen, & line_gen, WRAP_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+void wrap_job_run(void * arg) {
+  WrapJob * job = arg;
+  for (int i = job -> first; i < job -> last; i++) {
+    if (__atomic_load_n( & job -> cancel, __ATOMIC_ACQUIRE)) break;
+    Line * line = line_table_get(job -> lines, i);
+    if (!line_claim_wrap(line, job -> gen)) continue;
+    calculate_line_wraps(line, job -> width, & job -> arena);
+    job -> heights[i - job -> first] = line -> wrapped_lines;
+    __atomic_store_n( & line -> wrap_gen, job -> gen, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n( & job -> done, 1, __ATOMIC_RELEASE);
+  event_wake();
+}
+int wrap_job_submit(Buffer * buf, int first, int last) {
+  WrapJob * job = calloc(1, sizeof(WrapJob));
+  if (!job) return -1;
+  job -> heights = calloc(last - first, sizeof(int));
+  if (!job -> heights) {
+    free(job);
+    return -1;
+  }
+  job -> lines = buf -> lines;
+  job -> first = first;
+  job -> last = last;
+  job -> gen = buf -> wrap_gen;
+  job -> width = buf -> wrap_width;
+  job -> next = buf -> wrap_jobs;
+  buf -> wrap_jobs = job;
+  // The job is already listed, so it must finish for pool_wait to return
+  if (pool_submit(wrap_job_run, job) < 0) wrap_job_run(job);
+  return 0;
+}
+void wrap_job_free(WrapJob * job) {
+  arena_reset( & job -> arena);
+  free(job -> heights);
+  free(job);
+}
+void buffer_schedule_wraps(Buffer * buf) {
+  int settled = buffer_settled(buf);
+  if (buf -> chop_lines || buf -> wrap_gen == 0 || buf -> refine_pos >= settled) return;
+  // Jobs only cover lines already in the tree so their heights can be folded
+  wrap_tree_extend(buf);
+  int end = buf -> tree_count < settled ? buf -> tree_count : settled;
+  int start = buf -> refine_pos;
+  if (start == 0 && buf -> current_line > 0 && buf -> current_line < end) {
+    // Fresh rewrap: work outwards from the viewport
+    for (int i = buf -> current_line; i < end; i += WRAP_JOB_LINES) {
+      wrap_job_submit(buf, i, i + WRAP_JOB_LINES < end ? i + WRAP_JOB_LINES : end);
+    }
+    for (int i = buf -> current_line; i > 0; i -= WRAP_JOB_LINES) {
+      wrap_job_submit(buf, i > WRAP_JOB_LINES ? i - WRAP_JOB_LINES : 0, i);
+    }
+  } else {
+    for (int i = start; i < end; i += WRAP_JOB_LINES) {
+      wrap_job_submit(buf, i, i + WRAP_JOB_LINES < end ? i + WRAP_JOB_LINES : end);
+    }
+  }
+  buf -> refine_pos = end;
+}
+int buffer_collect_wraps(Buffer * buf) {
+  WrapJob ** link = & buf -> wrap_jobs;
+  int pending = 0;
+  while ( * link) {
+    WrapJob * job = * link;
+    if (!__atomic_load_n( & job -> done, __ATOMIC_ACQUIRE)) {
+      pending = 1;
+      link = & job -> next;
+      continue;
+    }
+    for (int i = job -> first; i < job -> last; i++) {
+      int delta = job -> heights[i - job -> first] - 1;
+      if (delta <= 0) continue;
+      wrap_tree_add(buf, i, delta);
+      // Keep the top of the viewport on the same file line
+      if (i < buf -> current_line) buf -> screen_line += delta;
+    }
+    // The job's wrap points now belong to the buffer
+    arena_splice( & buf -> wrap_arena, & job -> arena);
+    * link = job -> next;
+    wrap_job_free(job);
+  }
+  return pending;
+}
+// Drops in-flight jobs without folding them; only valid right before the
+// wrap generation is bumped or the buffer is destroyed, since the jobs'
+// arenas (and the wrap points in them) are freed here.
+void buffer_cancel_wraps(Buffer * buf) {
+  for (WrapJob * job = buf -> wrap_jobs; job; job = job -> next) {
+    __atomic_store_n( & job -> cancel, 1, __ATOMIC_RELEASE);
+  }
+  while (buf -> wrap_jobs) {
+    WrapJob * job = buf -> wrap_jobs;
+    pool_wait( & job -> done);
+    buf -> wrap_jobs = job -> next;
+    wrap_job_free(job);
+  }
+}
+// Waits for in-flight jobs and folds them in, for when a line's text is
+// about to change under them
+void buffer_finish_wraps(Buffer * buf) {
+  for (WrapJob * job = buf -> wrap_jobs; job; job = job -> next) {
+    pool_wait( & job -> done);
+  }
+  buffer_collect_wraps(buf);
+}
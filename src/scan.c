@@ -0,0 +1,198 @@
+#include "../include/least.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Every scanner stores the address of each delimiter in [pos, end), up to
+// max of them, and returns how many it found. A caller that gets max back
+// resumes from just past the last one.
+int scan_scalar(const char * pos, const char * end, int delims, const char ** ends, int max) {
+  int found = 0;
+  int newline = delims & SCAN_NEWLINE;
+  int nul = delims & SCAN_NUL;
+  for (; pos < end && found < max; pos++) {
+    if ((newline && * pos == '\n') || (nul && * pos == '\0')) ends[found++] = pos;
+  }
+  return found;
+}
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+int scan_sse2(const char * pos, const char * end, int delims, const char ** ends, int max) {
+  int found = 0;
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  unsigned int newline_mask = delims & SCAN_NEWLINE ? 0xffffu : 0;
+  unsigned int nul_mask = delims & SCAN_NUL ? 0xffffu : 0;
+  while (end - pos >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i * ) pos);
+    unsigned int mask = ((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) & newline_mask) |
+      ((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nul)) & nul_mask);
+    while (mask) {
+      ends[found++] = pos + __builtin_ctz(mask);
+      if (found == max) return found;
+      mask &= mask - 1;
+    }
+    pos += 16;
+  }
+  return found + scan_scalar(pos, end, delims, ends + found, max - found);
+}
+__attribute__((target("avx2")))
+int scan_avx2(const char * pos, const char * end, int delims, const char ** ends, int max) {
+  int found = 0;
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  unsigned int newline_mask = delims & SCAN_NEWLINE ? 0xffffffffu : 0;
+  unsigned int nul_mask = delims & SCAN_NUL ? 0xffffffffu : 0;
+  while (end - pos >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i * ) pos);
+    unsigned int mask = ((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)) & newline_mask) |
+      ((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nul)) & nul_mask);
+    while (mask) {
+      ends[found++] = pos + __builtin_ctz(mask);
+      if (found == max) return found;
+      mask &= mask - 1;
+    }
+    pos += 32;
+  }
+  return found + scan_sse2(pos, end, delims, ends + found, max - found);
+}
+#endif
+ScanFunc scan_select(const char * name) {
+  if (strcmp(name, "scalar") == 0) return scan_scalar;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return scan_sse2;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return scan_avx2;
+#endif
+  return NULL;
+}
+int scan_line_ends(const char * pos, const char * end, int delims, const char ** ends, int max) {
+  // Picked on first use; every thread would pick the same one, so the race
+  // on the pointer is harmless
+  static ScanFunc scan = NULL;
+  ScanFunc chosen = __atomic_load_n( & scan, __ATOMIC_RELAXED);
+  if (!chosen) {
+    if (!(chosen = scan_select("avx2")) && !(chosen = scan_select("sse2"))) chosen = scan_scalar;
+    __atomic_store_n( & scan, chosen, __ATOMIC_RELAXED);
+  }
+  return chosen(pos, end, delims, ends, max);
+}
+// Every finder returns the first occurrence of needle[0, size) in [pos, end),
+// or NULL. Size is at least 2: candidates are positions where both the first
+// and the last byte of the needle line up, and only those are compared whole.
+const char * find_scalar(const char * pos, const char * end, const char * needle, size_t size) {
+  for (; (size_t)(end - pos) >= size; pos++) {
+    pos = memchr(pos, needle[0], end - pos - size + 1);
+    if (!pos) return NULL;
+    if (pos[size - 1] == needle[size - 1] && memcmp(pos + 1, needle + 1, size - 2) == 0) return pos;
+  }
+  return NULL;
+}
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+const char * find_sse2(const char * pos, const char * end, const char * needle, size_t size) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[size - 1]);
+  while ((size_t)(end - pos) >= size - 1 + 16) {
+    __m128i head = _mm_loadu_si128((const __m128i * ) pos);
+    __m128i tail = _mm_loadu_si128((const __m128i * )(pos + size - 1));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+    while (mask) {
+      const char * candidate = pos + __builtin_ctz(mask);
+      if (memcmp(candidate + 1, needle + 1, size - 2) == 0) return candidate;
+      mask &= mask - 1;
+    }
+    pos += 16;
+  }
+  return find_scalar(pos, end, needle, size);
+}
+__attribute__((target("avx2")))
+const char * find_avx2(const char * pos, const char * end, const char * needle, size_t size) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[size - 1]);
+  while ((size_t)(end - pos) >= size - 1 + 32) {
+    __m256i head = _mm256_loadu_si256((const __m256i * ) pos);
+    __m256i tail = _mm256_loadu_si256((const __m256i * )(pos + size - 1));
+    unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+    while (mask) {
+      const char * candidate = pos + __builtin_ctz(mask);
+      if (memcmp(candidate + 1, needle + 1, size - 2) == 0) return candidate;
+      mask &= mask - 1;
+    }
+    pos += 32;
+  }
+  return find_sse2(pos, end, needle, size);
+}
+#endif
+FindFunc find_select(const char * name) {
+  if (strcmp(name, "scalar") == 0) return find_scalar;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return find_sse2;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return find_avx2;
+#endif
+  return NULL;
+}
+// Every printable checker returns 1 if [pos, end) holds nothing but
+// printable ASCII, which is one column a byte in any locale
+int printable_scalar(const char * pos, const char * end) {
+  for (; pos < end; pos++) {
+    if ((unsigned char) * pos < ' ' || (unsigned char) * pos > '~') return 0;
+  }
+  return 1;
+}
+#ifdef SCAN_X86
+// As signed bytes, printable ASCII is exactly the range (0x1f, 0x7f)
+__attribute__((target("sse2")))
+int printable_sse2(const char * pos, const char * end) {
+  const __m128i low = _mm_set1_epi8(0x1f);
+  const __m128i high = _mm_set1_epi8(0x7f);
+  while (end - pos >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i * ) pos);
+    if (_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmpgt_epi8(high, v))) != 0xffff) return 0;
+    pos += 16;
+  }
+  return printable_scalar(pos, end);
+}
+__attribute__((target("avx2")))
+int printable_avx2(const char * pos, const char * end) {
+  const __m256i low = _mm256_set1_epi8(0x1f);
+  const __m256i high = _mm256_set1_epi8(0x7f);
+  while (end - pos >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i * ) pos);
+    if ((unsigned int) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v))) != 0xffffffffu) return 0;
+    pos += 32;
+  }
+  return printable_sse2(pos, end);
+}
+#endif
+PrintableFunc printable_select(const char * name) {
+  if (strcmp(name, "scalar") == 0) return printable_scalar;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return printable_sse2;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return printable_avx2;
+#endif
+  return NULL;
+}
+int scan_printable(const char * pos, const char * end) {
+  static PrintableFunc printable = NULL;
+  PrintableFunc chosen = __atomic_load_n( & printable, __ATOMIC_RELAXED);
+  if (!chosen) {
+    if (!(chosen = printable_select("avx2")) && !(chosen = printable_select("sse2"))) chosen = printable_scalar;
+    __atomic_store_n( & printable, chosen, __ATOMIC_RELAXED);
+  }
+  return chosen(pos, end);
+}
+const char * scan_find(const char * pos, const char * end, const char * needle, size_t size) {
+  static FindFunc find = NULL;
+  if (size == 0) return pos;
+  if (size == 1) return memchr(pos, needle[0], end - pos);
+  FindFunc chosen = __atomic_load_n( & find, __ATOMIC_RELAXED);
+  if (!chosen) {
+    if (!(chosen = find_select("avx2")) && !(chosen = find_select("sse2"))) chosen = find_scalar;
+    __atomic_store_n( & find, chosen, __ATOMIC_RELAXED);
+  }
+  return chosen(pos, end, needle, size);
+}
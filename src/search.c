@@ -0,0 +1,543 @@
+#include "../include/least.h"
+
+// Room for lines more lines and matches more matches
+int match_table_reserve(MatchTable * table, int lines, int matches) {
+  if (table -> line_count + lines > table -> line_capacity) {
+    int new_capacity = table -> line_capacity == 0 ? 64 : table -> line_capacity * 2;
+    if (new_capacity < table -> line_count + lines) new_capacity = table -> line_count + lines;
+    int * new_lines = realloc(table -> lines, new_capacity * sizeof(int));
+    if (!new_lines) return -1;
+    table -> lines = new_lines;
+    int * new_offsets = realloc(table -> offsets, (new_capacity + 1) * sizeof(int));
+    if (!new_offsets) return -1;
+    table -> offsets = new_offsets;
+    table -> line_capacity = new_capacity;
+  }
+  if (table -> match_count + matches > table -> match_capacity) {
+    int new_capacity = table -> match_capacity == 0 ? 64 : table -> match_capacity * 2;
+    if (new_capacity < table -> match_count + matches) new_capacity = table -> match_count + matches;
+    SearchMatch * new_matches = realloc(table -> matches, new_capacity * sizeof(SearchMatch));
+    if (!new_matches) return -1;
+    table -> matches = new_matches;
+    table -> match_capacity = new_capacity;
+  }
+  return 0;
+}
+// Matches must come in line order, and in order within a line
+int match_table_add(MatchTable * table, int line, SearchMatch match) {
+  int new_line = table -> line_count == 0 || table -> lines[table -> line_count - 1] != line;
+  if (match_table_reserve(table, new_line, 1) < 0) return -1;
+  if (new_line) {
+    table -> offsets[table -> line_count] = table -> match_count;
+    table -> lines[table -> line_count++] = line;
+  }
+  table -> matches[table -> match_count++] = match;
+  table -> offsets[table -> line_count] = table -> match_count;
+  return 0;
+}
+// Adds every line of src, which must all come after those of table
+int match_table_append(MatchTable * table, const MatchTable * src) {
+  if (src -> line_count == 0) return 0;
+  if (match_table_reserve(table, src -> line_count, src -> match_count) < 0) return -1;
+  for (int k = 0; k < src -> line_count; k++) {
+    table -> lines[table -> line_count + k] = src -> lines[k];
+    table -> offsets[table -> line_count + k] = table -> match_count + src -> offsets[k];
+  }
+  memcpy(table -> matches + table -> match_count, src -> matches, src -> match_count * sizeof(SearchMatch));
+  table -> line_count += src -> line_count;
+  table -> match_count += src -> match_count;
+  table -> offsets[table -> line_count] = table -> match_count;
+  return 0;
+}
+void match_table_free(MatchTable * table) {
+  free(table -> lines);
+  free(table -> offsets);
+  free(table -> matches);
+  memset(table, 0, sizeof( * table));
+}
+// The first position in lines[0, count) holding a line at or after line
+int search_lower_bound(const int * lines, int count, int line) {
+  int low = 0, high = count;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (lines[mid] < line) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+// Drops line and everything after it
+void match_table_truncate(MatchTable * table, int line) {
+  int k = search_lower_bound(table -> lines, table -> line_count, line);
+  if (k >= table -> line_count) return;
+  table -> line_count = k;
+  table -> match_count = table -> offsets[k];
+}
+const SearchMatch * match_table_find(const MatchTable * table, int line, int * count) {
+  int k = search_lower_bound(table -> lines, table -> line_count, line);
+  if (k == table -> line_count || table -> lines[k] != line) return NULL;
+  * count = table -> offsets[k + 1] - table -> offsets[k];
+  return table -> matches + table -> offsets[k];
+}
+// How many matches come before line's first one, or -1 if it has none
+int match_table_rank(const MatchTable * table, int line) {
+  int k = search_lower_bound(table -> lines, table -> line_count, line);
+  if (k == table -> line_count || table -> lines[k] != line) return -1;
+  return table -> offsets[k];
+}
+// The line holding match n, counting from 0, or -1 past the last one
+int match_table_select(const MatchTable * table, int n) {
+  if (n < 0 || n >= table -> match_count) return -1;
+  // The last line whose matches start at or before n
+  return table -> lines[search_lower_bound(table -> offsets, table -> line_count + 1, n + 1) - 1];
+}
+// The first matching line at or after from, or the last one before it for
+// a negative direction, wrapping around; -1 if there is none
+int match_table_next(const MatchTable * table, int from, int direction) {
+  if (table -> line_count == 0) return -1;
+  int k = search_lower_bound(table -> lines, table -> line_count, from);
+  if (direction > 0) return table -> lines[k < table -> line_count ? k : 0];
+  return table -> lines[k > 0 ? k - 1 : table -> line_count - 1];
+}
+int line_regexec(const regex_t * regex,
+  const Line * line, int offset, regmatch_t * pmatch) {
+  // Mapped lines are not NUL-terminated, so bound the match explicitly
+  pmatch[0].rm_so = offset;
+  pmatch[0].rm_eo = line -> length;
+  return regexec(regex, line -> content, 1, pmatch, REG_STARTEND | (offset > 0 ? REG_NOTBOL : 0));
+}
+// The next match in line from offset on: a literal pattern is found
+// directly, anything else goes through the regex. Returns 0 if there is one.
+int search_next_match(const SearchShard * shard,
+  const regex_t * regex, const Line * line, int offset, SearchMatch * match) {
+  if (shard -> literal) {
+    const char * found = scan_find(line -> content + offset, line -> content + line -> length, shard -> pattern, shard -> literal);
+    if (!found) return -1;
+    match -> start = found - line -> content;
+    match -> end = match -> start + shard -> literal;
+    return 0;
+  }
+  regmatch_t pmatch[1];
+  if (line_regexec(regex, line, offset, pmatch) != 0) return -1;
+  match -> start = pmatch[0].rm_so;
+  match -> end = pmatch[0].rm_eo;
+  return 0;
+}
+// The one scanning loop: every match in the shard's lines, in line order
+void search_scan(SearchShard * shard, const regex_t * regex) {
+  SearchMatch match;
+  for (int i = shard -> first; i < shard -> last; i++) {
+    if (shard -> search && __atomic_load_n( & shard -> search -> cancel, __ATOMIC_ACQUIRE)) break;
+    int index = shard -> subset ? shard -> subset[i] : i;
+    const Line * line = line_table_get(shard -> lines, index);
+    int offset = 0;
+    while (search_next_match(shard, regex, line, offset, & match) == 0) {
+      if (match_table_add( & shard -> found, index, match) < 0) return;
+      offset = match.end;
+      if (match.start == match.end) break;
+    }
+  }
+}
+pthread_once_t search_locale_once = PTHREAD_ONCE_INIT;
+locale_t search_locale = (locale_t) 0;
+void search_locale_init(void) {
+  search_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+}
+// Compiles pattern in the C locale whatever the terminal's, so regular
+// expressions match bytes like the literal path does, and glibc keeps to
+// its much faster single-byte matcher
+int search_regcomp(regex_t * regex, const char * pattern) {
+  pthread_once( & search_locale_once, search_locale_init);
+  locale_t previous = search_locale ? uselocale(search_locale) : (locale_t) 0;
+  int ret = regcomp(regex, pattern, REG_EXTENDED | REG_NEWLINE);
+  if (search_locale) uselocale(previous);
+  return ret;
+}
+void search_shard_run(void * arg) {
+  SearchShard * shard = arg;
+  Search * search = shard -> search;
+  if (shard -> literal) {
+    search_scan(shard, NULL);
+  } else {
+    // A private copy of the pattern: a shared regex_t serializes regexec
+    regex_t regex;
+    if (search_regcomp( & regex, shard -> pattern) == 0) {
+      search_scan(shard, & regex);
+      regfree( & regex);
+    }
+  }
+  __atomic_store_n( & shard -> done, 1, __ATOMIC_RELEASE);
+  event_wake();
+  search_release(search);
+}
+int search_table_order(const void * a, const void * b) {
+  const MatchTable * x = * (const MatchTable * const * ) a;
+  const MatchTable * y = * (const MatchTable * const * ) b;
+  return x -> lines[0] - y -> lines[0];
+}
+// Joins the matches of every shard with those already in the index, then
+// frees the shards' own copies
+void search_build_index(Search * search) {
+  const MatchTable ** order = malloc((search -> shard_count + 1) * sizeof(MatchTable * ));
+  if (!order) return;
+  int tables = 0, lines = 0, matches = 0;
+  for (int s = 0; s <= search -> shard_count; s++) {
+    const MatchTable * found = s < search -> shard_count ? & search -> shards[s] -> found : & search -> index;
+    if (found -> line_count == 0) continue;
+    order[tables++] = found;
+    lines += found -> line_count;
+    matches += found -> match_count;
+  }
+  // Shards cover disjoint ranges, and the index only lines before or after
+  // those still to join, so ordering the tables orders their lines
+  qsort(order, tables, sizeof(MatchTable * ), search_table_order);
+  MatchTable index = {0};
+  int failed = match_table_reserve( & index, lines, matches);
+  for (int t = 0; t < tables && !failed; t++) failed = match_table_append( & index, order[t]);
+  free(order);
+  if (failed) {
+    match_table_free( & index);
+    return;
+  }
+  match_table_free( & search -> index);
+  search -> index = index;
+  for (int s = 0; s < search -> shard_count; s++) match_table_free( & search -> shards[s] -> found);
+  search -> indexed = 1;
+}
+// Makes the matches of newly finished shards visible
+int buffer_collect_search(Buffer * buf) {
+  Search * search = buf -> search;
+  if (!search || search -> merged == search -> shard_count) return 0;
+  int merged = search -> merged;
+  for (int s = 0; s < search -> shard_count; s++) {
+    SearchShard * shard = search -> shards[s];
+    if (shard -> merged || !__atomic_load_n( & shard -> done, __ATOMIC_ACQUIRE)) continue;
+    shard -> merged = 1;
+    search -> merged++;
+  }
+  if (search -> merged == merged) return 0;
+  if (search -> merged == search -> shard_count) search_build_index(search);
+  buf -> match_gen++;
+  buf -> dirty = 1;
+  return 1;
+}
+// Puts a shard for positions [first, last) of subset, or of every line, at
+// position at in the queue order
+int search_add_shard(Search * search, int at, LineTable * lines,
+  const int * subset, int first, int last) {
+  if (search -> shard_count == search -> shard_capacity) {
+    int new_capacity = search -> shard_capacity == 0 ? 16 : search -> shard_capacity * 2;
+    SearchShard ** new_shards = realloc(search -> shards, new_capacity * sizeof(SearchShard * ));
+    if (!new_shards) return -1;
+    search -> shards = new_shards;
+    search -> shard_capacity = new_capacity;
+  }
+  SearchShard * shard = calloc(1, sizeof(SearchShard));
+  if (!shard) return -1;
+  shard -> lines = lines;
+  shard -> pattern = search -> pattern;
+  shard -> literal = search -> literal;
+  shard -> subset = subset;
+  shard -> first = first;
+  shard -> last = last;
+  shard -> search = search;
+  memmove(search -> shards + at + 1, search -> shards + at, (search -> shard_count - at) * sizeof(SearchShard * ));
+  search -> shards[at] = shard;
+  search -> shard_count++;
+  return 0;
+}
+void search_submit(SearchShard * shard) {
+  if (pool_submit_first(search_shard_run, shard) < 0) search_shard_run(shard);
+}
+void search_free(Search * search) {
+  for (int s = 0; s < search -> shard_count; s++) {
+    match_table_free( & search -> shards[s] -> found);
+    free(search -> shards[s]);
+  }
+  regfree( & search -> regex);
+  free(search -> shards);
+  match_table_free( & search -> index);
+  free(search -> subset);
+  free(search -> pattern);
+  free(search);
+}
+int search_orphans = 0; // cancelled searches with shards still running
+// Drops one reference to search; only a cancelled search loses its last
+void search_release(Search * search) {
+  if (__atomic_sub_fetch( & search -> refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+  search_free(search);
+  __atomic_sub_fetch( & search_orphans, 1, __ATOMIC_RELEASE);
+}
+// Stops the buffer's search without waiting for it: shards still running
+// skip their remaining lines and the last of them frees the search
+void buffer_cancel_search(Buffer * buf) {
+  Search * search = buf -> search;
+  if (!search) return;
+  __atomic_store_n( & search -> cancel, 1, __ATOMIC_RELEASE);
+  __atomic_add_fetch( & search_orphans, 1, __ATOMIC_ACQ_REL);
+  search_release(search);
+  buf -> search = NULL;
+  buf -> match_gen++;
+}
+// Waits for cancelled searches to stop reading lines, for when text they
+// may still be scanning is about to change or go away
+void search_wait_orphans(void) {
+  pool_wait_zero( & search_orphans);
+}
+// Waits for the rest of the shards and merges them, for when a line's text
+// is about to change under them
+void buffer_finish_search(Buffer * buf) {
+  Search * search = buf -> search;
+  if (!search) return;
+  for (int s = 0; s < search -> shard_count; s++) pool_wait( & search -> shards[s] -> done);
+  buffer_collect_search(buf);
+}
+// Searches the lines indexed since the search started or was last
+// extended. They come before the shards that wrap around: right after the
+// others for a forward search, and first among the wrapped ones, which run
+// from the end of the buffer down, for a backward one.
+void buffer_search_extend(Buffer * buf) {
+  Search * search = buf -> search;
+  if (!search) return;
+  int settled = buffer_settled(buf);
+  for (int i = search -> count; i < settled; i += SEARCH_SHARD_LINES) {
+    int last = i + SEARCH_SHARD_LINES < settled ? i + SEARCH_SHARD_LINES : settled;
+    if (search_add_shard(search, search -> around, buf -> lines, NULL, i, last) < 0) return;
+    SearchShard * shard = search -> shards[search -> around];
+    if (search -> direction > 0) search -> around++;
+    search -> count = last;
+    search -> indexed = 0;
+    __atomic_add_fetch( & search -> refs, 1, __ATOMIC_ACQ_REL);
+    search_submit(shard);
+  }
+}
+// The indexer may still add lines the search has not covered
+int search_partial(const Buffer * buf) {
+  return buf -> indexer || buf -> search -> count < buf -> count;
+}
+// Indexes the rest of the buffer and finishes searching it, for an answer
+// that would otherwise wrap around past lines not read yet
+void buffer_search_complete(Buffer * buf) {
+  buffer_wait_lines(buf, INT_MAX);
+  buffer_search_extend(buf);
+  buffer_finish_search(buf);
+}
+// Whether line, found going direction from from, lies past the wrap around
+int search_wraps(int from, int direction, int line) {
+  return direction > 0 ? line < from : line >= from;
+}
+int search_literal(const char * pattern) {
+  return strpbrk(pattern, ".[]()*+?{}|^$\\") == NULL;
+}
+// Starts a search for pattern from line from without waiting for it. When
+// both it and the buffer's indexed previous search are literals and the new
+// pattern extends the old one, only the lines that matched before are
+// scanned. Returns SEARCH_INVALID if the pattern does not compile, or
+// SEARCH_NO_MEMORY.
+int buffer_search_start(Buffer * buf,
+  const char * pattern, int direction, int from) {
+  Search * search = calloc(1, sizeof(Search));
+  if (!search) return SEARCH_NO_MEMORY;
+  int error = search_regcomp( & search -> regex, pattern);
+  if (error) {
+    free(search);
+    return error == REG_ESPACE ? SEARCH_NO_MEMORY : SEARCH_INVALID;
+  }
+  search -> pattern = strdup(pattern);
+  search -> literal = search_literal(pattern) ? strlen(pattern) : 0;
+  search -> direction = direction;
+  search -> from = from;
+  search -> jumped = -1;
+  // A line still in the buffer's tail is scanned here, not by the shards
+  int settled = buffer_settled(buf);
+  search -> count = settled;
+  Search * prev = buf -> search;
+  int size = settled;
+  if (prev && prev -> indexed && prev -> count == buf -> count && prev -> literal && search -> literal && strncmp(pattern, prev -> pattern, strlen(prev -> pattern)) == 0) {
+    search -> subset = malloc((prev -> index.line_count + 1) * sizeof(int));
+    if (search -> subset) {
+      memcpy(search -> subset, prev -> index.lines, prev -> index.line_count * sizeof(int));
+      size = prev -> index.line_count;
+    }
+  }
+  // Otherwise a trigram index may rule out most of the file
+  if (!search -> subset) search -> subset = trigram_candidates(buf, pattern, & size);
+  if (search -> subset) size = search_lower_bound(search -> subset, size, settled);
+  // Positions index the subset when there is one, lines otherwise
+  int start = from < settled ? from : settled;
+  if (search -> subset) start = search_lower_bound(search -> subset, size, from);
+  // Shards are queued nearest first, wrapping around the end of the buffer,
+  // and ahead of any wrap jobs
+  int failed = !search -> pattern;
+  if (direction > 0) {
+    for (int i = start; i < size && !failed; i += SEARCH_SHARD_LINES) {
+      failed = search_add_shard(search, search -> shard_count, buf -> lines, search -> subset, i, i + SEARCH_SHARD_LINES < size ? i + SEARCH_SHARD_LINES : size) < 0;
+    }
+    search -> around = search -> shard_count;
+    for (int i = 0; i < start && !failed; i += SEARCH_SHARD_LINES) {
+      failed = search_add_shard(search, search -> shard_count, buf -> lines, search -> subset, i, i + SEARCH_SHARD_LINES < start ? i + SEARCH_SHARD_LINES : start) < 0;
+    }
+  } else {
+    for (int i = start; i > 0 && !failed; i -= SEARCH_SHARD_LINES) {
+      failed = search_add_shard(search, search -> shard_count, buf -> lines, search -> subset, i > SEARCH_SHARD_LINES ? i - SEARCH_SHARD_LINES : 0, i) < 0;
+    }
+    search -> around = search -> shard_count;
+    for (int i = size; i > start && !failed; i -= SEARCH_SHARD_LINES) {
+      failed = search_add_shard(search, search -> shard_count, buf -> lines, search -> subset, i - SEARCH_SHARD_LINES > start ? i - SEARCH_SHARD_LINES : start, i) < 0;
+    }
+  }
+  if (failed) {
+    search_free(search);
+    return SEARCH_NO_MEMORY;
+  }
+  buffer_cancel_search(buf);
+  buf -> search = search;
+  buf -> match_gen++;
+  search -> refs = search -> shard_count + 1;
+  for (int s = 0; s < search -> shard_count; s++) search_submit(search -> shards[s]);
+  buffer_search_appended(buf, settled);
+  // Nothing to scan: the (empty) result is already complete
+  if (search -> shard_count == 0) search_build_index(search);
+  return 0;
+}
+// The match nearest to where the search started: the first shard in queue
+// order with any hit decides, and none past the wrap around while lines are
+// still being indexed. Returns -1 if there is none, or SEARCH_PENDING if
+// that is not known yet and wait is not set.
+int buffer_search_nearest(Buffer * buf, int wait) {
+  Search * search = buf -> search;
+  if (!search) return -1;
+  if (search -> indexed) {
+    int line = match_table_next( & search -> index, search -> from, search -> direction);
+    if ((line >= 0 && !search_wraps(search -> from, search -> direction, line)) || !search_partial(buf)) return line;
+    if (!wait) return SEARCH_PENDING;
+    buffer_search_complete(buf);
+    return match_table_next( & search -> index, search -> from, search -> direction);
+  }
+  for (int s = 0; s <= search -> shard_count; s++) {
+    if (s == search -> around && search_partial(buf)) {
+      if (!wait) return SEARCH_PENDING;
+      buffer_search_complete(buf);
+      if (search -> indexed) return match_table_next( & search -> index, search -> from, search -> direction);
+    }
+    if (s == search -> shard_count) break;
+    SearchShard * shard = search -> shards[s];
+    if (!__atomic_load_n( & shard -> done, __ATOMIC_ACQUIRE)) {
+      if (!wait) return SEARCH_PENDING;
+      pool_wait( & shard -> done);
+    }
+    if (shard -> found.line_count > 0) {
+      return shard -> found.lines[search -> direction > 0 ? 0 : shard -> found.line_count - 1];
+    }
+  }
+  return -1;
+}
+// Searches from the current line and waits only until the nearest match is
+// known; the remaining shards keep running and are merged by
+// buffer_collect_search(). Returns the matching line, -1 if there is none,
+// or the error from buffer_search_start().
+int buffer_search(Buffer * buf,
+  const char * pattern, int direction) {
+  int error = buffer_search_start(buf, pattern, direction, buf -> current_line);
+  if (error < 0) return error;
+  int found = buffer_search_nearest(buf, 1);
+  buffer_collect_search(buf);
+  return found;
+}
+// The matching line after the current one, or before it for a negative
+// direction, wrapping around the buffer. Once the buffer's search for the
+// same pattern is indexed this is a binary search; otherwise a new search
+// starts just past the current line. Returns as buffer_search().
+int buffer_search_next(Buffer * buf,
+  const char * pattern, int direction) {
+  Search * search = buf -> search;
+  if (search && strcmp(search -> pattern, pattern) == 0) {
+    // Finishing the scan in flight is never slower than starting over
+    buffer_finish_search(buf);
+    if (search -> indexed) {
+      int from = direction > 0 ? buf -> current_line + 1 : buf -> current_line;
+      int line = match_table_next( & search -> index, from, direction);
+      // Wrapping around waits for the lines not indexed yet
+      if ((line < 0 || search_wraps(from, direction, line)) && search_partial(buf)) {
+        buffer_search_complete(buf);
+        line = match_table_next( & search -> index, from, direction);
+      }
+      // Stepping moves by lines, so the view lands on the line's first match
+      if (line >= 0) {
+        search -> jumped = match_table_rank( & search -> index, line);
+        search -> jumped_line = line;
+      }
+      return line;
+    }
+  }
+  int from = direction > 0 ? buf -> current_line + 1 : buf -> current_line;
+  int error = buffer_search_start(buf, pattern, direction, from);
+  if (error < 0) return error;
+  int found = buffer_search_nearest(buf, 1);
+  buffer_collect_search(buf);
+  return found;
+}
+// Matches lines from first on against the buffer's search so text appended
+// in follow mode or from a pipe is highlighted like the rest
+void buffer_search_appended(Buffer * buf, int first) {
+  if (!buf -> search || first >= buf -> count) return;
+  Search * search = buf -> search;
+  SearchShard shard = {
+    .lines = buf -> lines,
+    .pattern = search -> pattern,
+    .literal = search -> literal,
+    .first = first,
+    .last = buf -> count
+  };
+  search_scan( & shard, & search -> regex);
+  // A continued last line is listed again if it still matches
+  match_table_truncate( & search -> index, first);
+  // Without room the index no longer lists every match, and stepping falls
+  // back to scanning
+  if (match_table_append( & search -> index, & shard.found) < 0) search -> indexed = 0;
+  search -> count = buf -> count;
+  match_table_free( & shard.found);
+}
+// The matches on one line, from the index or, while the search runs, from
+// whichever merged shard covers the line
+const SearchMatch * buffer_line_matches(const Buffer * buf, int line, int * count) {
+  const Search * search = buf -> search;
+  * count = 0;
+  if (!search) return NULL;
+  const SearchMatch * matches = match_table_find( & search -> index, line, count);
+  if (matches || search -> indexed) return matches;
+  for (int s = 0; s < search -> shard_count; s++) {
+    const MatchTable * found = & search -> shards[s] -> found;
+    if (!search -> shards[s] -> merged || found -> line_count == 0) continue;
+    if (line >= found -> lines[0] && line <= found -> lines[found -> line_count - 1]) return match_table_find(found, line, count);
+  }
+  return NULL;
+}
+// How many matches the buffer's search found, or -1 until it has finished
+int buffer_match_count(const Buffer * buf) {
+  if (!buf -> search || !buf -> search -> indexed) return -1;
+  return buf -> search -> index.match_count;
+}
+// Which match, counting from 0, the view is on: the one last jumped to
+// until the view scrolls off its line, then the first on the top line. -1
+// if there is none or the search has not finished.
+int buffer_match_current(Buffer * buf) {
+  Search * search = buf -> search;
+  if (!search || !search -> indexed) return -1;
+  if (search -> jumped_line != buf -> current_line) search -> jumped = -1;
+  if (search -> jumped >= 0) return search -> jumped;
+  return match_table_rank( & search -> index, buf -> current_line);
+}
+// The line holding match n, counting from 0, once the search has finished;
+// -1 if there is no such match
+int buffer_match_line(Buffer * buf, int n) {
+  buffer_finish_search(buf);
+  if (!buf -> search || !buf -> search -> indexed) return -1;
+  // Match n may be on a line not indexed yet
+  if (n >= buf -> search -> index.match_count && search_partial(buf)) buffer_search_complete(buf);
+  int line = match_table_select( & buf -> search -> index, n);
+  if (line >= 0) {
+    buf -> search -> jumped = n;
+    buf -> search -> jumped_line = line;
+  }
+  return line;
+}
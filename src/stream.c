@@ -0,0 +1,115 @@
+#include "../include/least.h"
+
+// Piped stdin is read as it arrives. A NUL ends the current pipe-N buffer and
+// the next byte of content starts a new one.
+static int stream_fd = -1;
+static LineTable * stream_target = NULL; // lines of the buffer being filled
+static int stream_dropping = 0; // the target was closed, skip to the next NUL
+static int stream_count = 0;
+static char stream_chunk[STREAM_CHUNK];
+
+Buffer * stream_buffer(Editor * ed) {
+  for (int b = 0; b < ed -> num_buffers; b++) {
+    if (stream_target && ed -> buffers[b].lines == stream_target) return & ed -> buffers[b];
+  }
+  Buffer * buf = editor_new_buffer(ed);
+  if (!buf) return NULL;
+  char pipe_name[32];
+  snprintf(pipe_name, sizeof(pipe_name), "pipe-%d", ++stream_count);
+  buf -> filename = strdup(pipe_name);
+  if (!buf -> filename) {
+    line_table_free(buf -> lines);
+    ed -> num_buffers--;
+    return NULL;
+  }
+  buf -> streaming = 1;
+  stream_target = buf -> lines;
+  return buf;
+}
+// A NUL or the end of the pipe also ends the buffer's last line
+void stream_end_buffer(Editor * ed) {
+  for (int b = 0; b < ed -> num_buffers; b++) {
+    Buffer * buf = & ed -> buffers[b];
+    if (!stream_target || buf -> lines != stream_target) continue;
+    buf -> streaming = 0;
+    buffer_search_appended(buf, buffer_flush_tail(buf));
+  }
+  stream_target = NULL;
+}
+void stream_feed(Editor * ed, const char * data, size_t size) {
+  const char * pos = data;
+  const char * end = data + size;
+  while (pos < end) {
+    const char * nul = NULL;
+    scan_line_ends(pos, end, SCAN_NUL, & nul, 1);
+    const char * stop = nul ? nul : end;
+    if (stop > pos && !stream_dropping) {
+      Buffer * buf = stream_buffer(ed);
+      char * text = buf ? arena_alloc( & buf -> text_arena, stop - pos) : NULL;
+      if (text) {
+        memcpy(text, pos, stop - pos);
+        int first = buffer_append_text(buf, text, stop - pos);
+        buffer_search_appended(buf, first);
+      } else {
+        // Without room the rest of this document is skipped; a closed
+        // target is skipped silently
+        if (buf) buf -> dropped = 1;
+        stream_dropping = 1;
+      }
+    }
+    if (!nul) break;
+    stream_end_buffer(ed);
+    stream_dropping = 0;
+    pos = nul + 1;
+  }
+}
+void stream_close(Editor * ed) {
+  stream_end_buffer(ed);
+  event_unwatch(stream_fd);
+  close(stream_fd);
+  stream_fd = -1;
+}
+// Reads at most one chunk per wakeup; poll() reports the pipe again while
+// more is buffered, so keys are handled between chunks of a fast producer
+void stream_readable(Editor * ed, int fd, void * arg) {
+  (void) arg;
+  size_t size = 0;
+  ssize_t got = 0;
+  while (size < sizeof(stream_chunk)) {
+    got = read(fd, stream_chunk + size, sizeof(stream_chunk) - size);
+    if (got <= 0) break;
+    size += got;
+  }
+  if (size > 0) stream_feed(ed, stream_chunk, size);
+  if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) stream_close(ed);
+}
+int stream_open(int fd) {
+  stream_fd = dup(fd);
+  if (stream_fd < 0) return -1;
+  fcntl(stream_fd, F_SETFD, FD_CLOEXEC);
+  return 0;
+}
+// With nothing else to show, blocks until the pipe has produced a buffer or
+// hit EOF; the rest is read by the event loop
+void stream_prime(Editor * ed) {
+  if (stream_fd < 0) return;
+  while (ed -> num_buffers == 0) {
+    ssize_t got = read(stream_fd, stream_chunk, sizeof(stream_chunk));
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) {
+      close(stream_fd);
+      stream_fd = -1;
+      stream_end_buffer(ed);
+      return;
+    }
+    stream_feed(ed, stream_chunk, got);
+  }
+  fcntl(stream_fd, F_SETFL, fcntl(stream_fd, F_GETFL) | O_NONBLOCK);
+  if (event_watch(stream_fd, stream_readable, NULL) < 0) stream_close(ed);
+}
+void stream_detach(Buffer * buf) {
+  if (stream_target && buf -> lines == stream_target) {
+    stream_target = NULL;
+    stream_dropping = 1;
+  }
+}
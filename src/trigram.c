@@ -0,0 +1,289 @@
+#include "../include/least.h"
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t block;
+  uint32_t buckets;
+  uint32_t blocks;
+  uint64_t size;
+  uint64_t mtime_sec;
+  uint64_t mtime_nsec;
+  uint64_t inode;
+  uint64_t device;
+} TrigramHeader;
+
+unsigned int trigram_hash(unsigned char a, unsigned char b, unsigned char c) {
+  uint32_t trigram = (uint32_t) a << 16 | (uint32_t) b << 8 | c;
+  return (trigram * 2654435761u) >> 18;
+}
+// $XDG_CACHE_HOME/least/<hash of the real path>.tri, or under ~/.cache
+char * trigram_cache_path(const char * filename) {
+  char * real = realpath(filename, NULL);
+  if (!real) return NULL;
+  uint64_t hash = 14695981039346656037ull;
+  for (const char * p = real; * p; p++) hash = (hash ^ (unsigned char) * p) * 1099511628211ull;
+  free(real);
+  const char * cache = getenv("XDG_CACHE_HOME");
+  const char * home = getenv("HOME");
+  char path[PATH_MAX];
+  if (cache && * cache) snprintf(path, sizeof(path), "%s/least/%016llx.tri", cache, (unsigned long long) hash);
+  else if (home && * home) snprintf(path, sizeof(path), "%s/.cache/least/%016llx.tri", home, (unsigned long long) hash);
+  else return NULL;
+  return strdup(path);
+}
+void trigram_header(const TrigramIndex * ix, TrigramHeader * header) {
+  memset(header, 0, sizeof( * header));
+  memcpy(header -> magic, "LEASTTRI", 8);
+  header -> version = TRIGRAM_VERSION;
+  header -> block = TRIGRAM_BLOCK;
+  header -> buckets = TRIGRAM_BUCKETS;
+  header -> blocks = ix -> blocks;
+  header -> size = ix -> size;
+  header -> mtime_sec = ix -> st.st_mtim.tv_sec;
+  header -> mtime_nsec = ix -> st.st_mtim.tv_nsec;
+  header -> inode = ix -> st.st_ino;
+  header -> device = ix -> st.st_dev;
+}
+// Reads the cache entry if it was built from this very file
+int trigram_load(TrigramIndex * ix) {
+  if (!ix -> cache_path) return -1;
+  int fd = open(ix -> cache_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  TrigramHeader expected, header;
+  trigram_header(ix, & expected);
+  size_t size = (size_t) TRIGRAM_BUCKETS * ix -> words * sizeof(uint64_t);
+  int ok = read(fd, & header, sizeof(header)) == (ssize_t) sizeof(header) && memcmp( & header, & expected, sizeof(header)) == 0;
+  for (size_t got = 0; ok && got < size;) {
+    ssize_t n = read(fd, (char * ) ix -> bits + got, size - got);
+    if (n <= 0) ok = 0;
+    else got += n;
+  }
+  close(fd);
+  return ok ? 0 : -1;
+}
+// Written under a temporary name and renamed, so readers see all or nothing
+void trigram_save(const TrigramIndex * ix) {
+  if (!ix -> cache_path) return;
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", ix -> cache_path);
+  for (char * slash = strchr(dir + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+    * slash = '\0';
+    mkdir(dir, 0700);
+    * slash = '/';
+  }
+  char temp[PATH_MAX];
+  snprintf(temp, sizeof(temp), "%s.%d", ix -> cache_path, (int) getpid());
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) return;
+  TrigramHeader header;
+  trigram_header(ix, & header);
+  size_t size = (size_t) TRIGRAM_BUCKETS * ix -> words * sizeof(uint64_t);
+  int ok = write(fd, & header, sizeof(header)) == (ssize_t) sizeof(header);
+  for (size_t put = 0; ok && put < size;) {
+    ssize_t n = write(fd, (const char * ) ix -> bits + put, size - put);
+    if (n <= 0) ok = 0;
+    else put += n;
+  }
+  if (close(fd) < 0) ok = 0;
+  if (ok && rename(temp, ix -> cache_path) == 0) return;
+  unlink(temp);
+}
+// A block also covers the trigrams starting in the pattern-length overlap
+// with the next one, so a string that starts in it is found whole
+void trigram_build(TrigramIndex * ix) {
+  uint64_t seen[TRIGRAM_BUCKETS / 64];
+  for (int b = 0; b < ix -> blocks; b++) {
+    if (__atomic_load_n( & ix -> cancel, __ATOMIC_ACQUIRE)) return;
+    size_t start = (size_t) b * TRIGRAM_BLOCK;
+    size_t end = start + TRIGRAM_BLOCK + SEARCH_BUFFER_SIZE;
+    if (end > ix -> size) end = ix -> size;
+    const unsigned char * data = (const unsigned char * ) ix -> data;
+    memset(seen, 0, sizeof(seen));
+    for (size_t p = start; p + 2 < end; p++) {
+      unsigned int bucket = trigram_hash(data[p], data[p + 1], data[p + 2]);
+      seen[bucket / 64] |= 1ull << (bucket % 64);
+    }
+    for (int w = 0; w < TRIGRAM_BUCKETS / 64; w++) {
+      for (uint64_t word = seen[w]; word; word &= word - 1) {
+        unsigned int bucket = w * 64 + __builtin_ctzll(word);
+        ix -> bits[(size_t) bucket * ix -> words + b / 64] |= 1ull << (b % 64);
+      }
+    }
+  }
+}
+void * trigram_run(void * arg) {
+  TrigramIndex * ix = arg;
+  if (trigram_load(ix) < 0) {
+    memset(ix -> bits, 0, (size_t) TRIGRAM_BUCKETS * ix -> words * sizeof(uint64_t));
+    trigram_build(ix);
+    if (!__atomic_load_n( & ix -> cancel, __ATOMIC_ACQUIRE)) trigram_save(ix);
+  }
+  __atomic_store_n( & ix -> done, 1, __ATOMIC_RELEASE);
+  event_wake();
+  return NULL;
+}
+int trigram_start(Buffer * buf) {
+  if (buf -> trigrams || !buf -> map || buf -> map_size == 0) return 0;
+  TrigramIndex * ix = calloc(1, sizeof(TrigramIndex));
+  if (!ix) return -1;
+  ix -> data = buf -> map;
+  ix -> size = buf -> map_size;
+  ix -> blocks = (buf -> map_size + TRIGRAM_BLOCK - 1) / TRIGRAM_BLOCK;
+  ix -> words = (ix -> blocks + 63) / 64;
+  ix -> bits = malloc((size_t) TRIGRAM_BUCKETS * ix -> words * sizeof(uint64_t));
+  if (!ix -> bits || stat(buf -> filename, & ix -> st) < 0) {
+    free(ix -> bits);
+    free(ix);
+    return -1;
+  }
+  ix -> cache_path = trigram_cache_path(buf -> filename);
+  if (pthread_create( & ix -> thread, NULL, trigram_run, ix) != 0) {
+    free(ix -> cache_path);
+    free(ix -> bits);
+    free(ix);
+    return -1;
+  }
+  buf -> trigrams = ix;
+  return 0;
+}
+void trigram_stop(Buffer * buf) {
+  TrigramIndex * ix = buf -> trigrams;
+  if (!ix) return;
+  __atomic_store_n( & ix -> cancel, 1, __ATOMIC_RELEASE);
+  pthread_join(ix -> thread, NULL);
+  free(ix -> cache_path);
+  free(ix -> bits);
+  free(ix);
+  buf -> trigrams = NULL;
+}
+// Skips a bracket expression, whose first ']' (after an optional '^') is
+// an ordinary character
+const char * trigram_skip_bracket(const char * p) {
+  p++;
+  if ( * p == '^') p++;
+  if ( * p == ']') p++;
+  while ( * p && * p != ']') p++;
+  return * p ? p + 1 : p;
+}
+// The longest run of characters that every match of the extended regular
+// expression must contain, copied to out; returns its length, 0 if none is
+// known. Alternation gives up; groups, quantified atoms and escapes that
+// stand for no fixed character end a run.
+int trigram_required(const char * pattern, char * out) {
+  if (strchr(pattern, '|')) return 0;
+  char run[SEARCH_BUFFER_SIZE];
+  int length = 0, best = 0, depth = 0;
+  for (const char * p = pattern; * p;) {
+    char c = 0;
+    int literal = 0;
+    if ( * p == '\\' && p[1]) {
+      // glibc reads \< \> \` \' as anchors and \w \s \b and the like as
+      // classes or boundaries, so only other escaped punctuation is literal
+      c = p[1];
+      literal = ispunct((unsigned char) c) && !strchr("<>`'", c);
+      p += 2;
+    } else if ( * p == '[') {
+      p = trigram_skip_bracket(p);
+    } else {
+      c = * p++;
+      if (c == '(') depth++;
+      else if (c == ')') depth--;
+      else literal = !strchr(".^$*+?{}", c);
+    }
+    int repeated = * p == '+';
+    int optional = * p == '*' || * p == '?' || * p == '{';
+    if ( * p == '{') {
+      while ( * p && * p != '}') p++;
+      if ( * p) p++;
+    } else if (repeated || optional) {
+      p++;
+    }
+    if (literal && depth == 0 && !optional && length < SEARCH_BUFFER_SIZE - 1) run[length++] = c;
+    else length = 0;
+    if (length > best) {
+      best = length;
+      memcpy(out, run, length);
+    }
+    // One copy is certain, what follows the repetition is not adjacent to it
+    if (repeated) length = 0;
+  }
+  return best;
+}
+// Byte offset just past line i, or SIZE_MAX for a line outside the mapping;
+// those only ever come after every mapped line
+size_t trigram_line_end(Buffer * buf, int i) {
+  const Line * line = buffer_line(buf, i);
+  if (line -> content < buf -> map || line -> content >= buf -> map + buf -> map_size) return SIZE_MAX;
+  return (size_t)(line -> content - buf -> map) + line -> length;
+}
+// The first line that ends past offset
+int trigram_line_after(Buffer * buf, size_t offset) {
+  int low = 0, high = buf -> count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (trigram_line_end(buf, mid) <= offset) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+int trigram_add_line(int ** lines, int * count, int * capacity, int line) {
+  if ( * count >= * capacity) {
+    int new_capacity = * capacity == 0 ? 1024 : * capacity * 2;
+    int * new_lines = realloc( * lines, new_capacity * sizeof(int));
+    if (!new_lines) return -1;
+    * lines = new_lines;
+    * capacity = new_capacity;
+  }
+  ( * lines)[( * count)++] = line;
+  return 0;
+}
+// The lines that can match pattern, ascending, in a new array; NULL when
+// the index is not ready, the pattern has no usable literal, or too much of
+// the file qualifies for narrowing to pay off
+int * trigram_candidates(Buffer * buf,
+  const char * pattern, int * count) {
+  TrigramIndex * ix = buf -> trigrams;
+  if (!ix || !__atomic_load_n( & ix -> done, __ATOMIC_ACQUIRE)) return NULL;
+  char literal[SEARCH_BUFFER_SIZE];
+  int length = trigram_required(pattern, literal);
+  if (length < 3) return NULL;
+  uint64_t * blocks = malloc(ix -> words * sizeof(uint64_t));
+  if (!blocks) return NULL;
+  memset(blocks, 0xff, ix -> words * sizeof(uint64_t));
+  for (int i = 0; i + 2 < length; i++) {
+    const uint64_t * row = ix -> bits + (size_t) trigram_hash(literal[i], literal[i + 1], literal[i + 2]) * ix -> words;
+    for (int w = 0; w < ix -> words; w++) blocks[w] &= row[w];
+  }
+  int candidates = 0;
+  for (int w = 0; w < ix -> words; w++) candidates += __builtin_popcountll(blocks[w]);
+  if (candidates > ix -> blocks / 2) {
+    free(blocks);
+    return NULL;
+  }
+  int * lines = NULL;
+  int found = 0, capacity = 0, failed = 0;
+  for (int w = 0; w < ix -> words && !failed; w++) {
+    for (uint64_t word = blocks[w]; word && !failed; word &= word - 1) {
+      size_t start = ((size_t) w * 64 + __builtin_ctzll(word)) * TRIGRAM_BLOCK;
+      int i = trigram_line_after(buf, start);
+      if (found > 0 && i <= lines[found - 1]) i = lines[found - 1] + 1;
+      for (; i < buf -> count && trigram_line_end(buf, i) != SIZE_MAX && !failed; i++) {
+        if (buffer_line(buf, i) -> content >= buf -> map + start + TRIGRAM_BLOCK) break;
+        failed = trigram_add_line( & lines, & found, & capacity, i) < 0;
+      }
+    }
+  }
+  // Lines appended since the file was mapped are not covered
+  for (int i = trigram_line_after(buf, ix -> size); i < buf -> count && !failed; i++) {
+    if (found == 0 || i > lines[found - 1]) failed = trigram_add_line( & lines, & found, & capacity, i) < 0;
+  }
+  free(blocks);
+  if (!failed && !lines) lines = malloc(sizeof(int));
+  if (failed || !lines) {
+    free(lines);
+    return NULL;
+  }
+  * count = found;
+  return lines;
+}
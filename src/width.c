@@ -0,0 +1,42 @@
+// wcwidth is an X/Open extension
+#define _GNU_SOURCE
+#include "../include/least.h"
+
+// Width of the character at pos, with its length in bytes in bytes. Tabs
+// depend on the column and are left to the caller. Returns -1 for a byte
+// that does not start a printable character, which is drawn as one '?'.
+int char_width(const char * pos, const char * end, int * bytes) {
+  unsigned char c = * pos;
+  * bytes = 1;
+  if (c < 0x80 || MB_CUR_MAX == 1) return isprint(c) ? 1 : 0;
+  mbstate_t state;
+  memset( & state, 0, sizeof(state));
+  wchar_t wc;
+  size_t n = mbrtowc( & wc, pos, end - pos, & state);
+  if (n == (size_t) -1 || n == (size_t) -2 || n == 0) return -1;
+  int width = wcwidth(wc);
+  if (width < 0) return -1;
+  * bytes = n;
+  return width;
+}
+// Columns ncurses takes to draw the character at pos with the cursor at
+// column x: tabs run to the next stop and control characters show as ^X.
+// Wrapping and chopping both measure with it so they agree on columns.
+int screen_char_width(const char * pos, const char * end, int x, int * bytes) {
+  unsigned char c = * pos;
+  * bytes = 1;
+  if (c == '\t') return TAB_SIZE - x % TAB_SIZE;
+  if (c == '\n' || c == '\r' || c == '\b') return 0;
+  if (c < ' ' || c == 0x7f) return 2;
+  if (c >= 0x80 && MB_CUR_MAX == 1) return c < 0xa0 ? 2 : 1;
+  int w = char_width(pos, end, bytes);
+  return w < 0 ? 1 : w;
+}
+// Width of a whole line from column 0. A line of printable ASCII, as most
+// log lines are, is a column a byte and needs no decoding.
+int line_display_width(const Line * line) {
+  int length = line -> length;
+  if (length > 0 && line -> content[length - 1] == '\n') length--;
+  if (scan_printable(line -> content, line -> content + length)) return length;
+  return get_display_width(line -> content, line -> length);
+}
@@ -0,0 +1,92 @@
+#include "../include/least.h"
+
+// Fenwick tree over line_height(). wrap_tree[k] (1-based) holds the sum of
+// the heights of lines (k - lowbit(k), k]; only the first tree_count lines
+// are covered and the rest are folded in lazily by wrap_tree_extend(). In
+// chop mode every line is one row, so the tree is never built and screen
+// rows map straight to lines.
+void wrap_tree_extend(Buffer * buf) {
+  if (buf -> chop_lines) return;
+  int count = buf -> count;
+  if (buf -> tree_count >= count) return;
+  if (count + 1 > buf -> tree_capacity) {
+    int new_capacity = buf -> tree_capacity == 0 ? 1024 : buf -> tree_capacity;
+    while (new_capacity < count + 1) new_capacity *= 2;
+    int * new_tree = realloc(buf -> wrap_tree, sizeof(int) * new_capacity);
+    if (!new_tree) return;
+    buf -> wrap_tree = new_tree;
+    buf -> tree_capacity = new_capacity;
+  }
+  int * tree = buf -> wrap_tree;
+  if (buf -> tree_count == 0) {
+    // Right after a reset every line is one row high, so a node's sum is
+    // just the size of the range it covers
+    for (int k = 1; k <= count; k++) tree[k] = k & -k;
+    buf -> total_wrapped_lines = count;
+  } else {
+    for (int k = buf -> tree_count + 1; k <= count; k++) {
+      int height = line_height(buf, buffer_line(buf, k - 1));
+      int value = height;
+      int low = k - (k & -k);
+      for (int j = k - 1; j > low; j -= j & -j) value += tree[j];
+      tree[k] = value;
+      buf -> total_wrapped_lines += height;
+    }
+  }
+  buf -> tree_count = count;
+}
+void wrap_tree_reset(Buffer * buf) {
+  buf -> tree_count = 0;
+  buf -> total_wrapped_lines = 0;
+}
+void wrap_tree_add(Buffer * buf, int line, int delta) {
+  if (line >= buf -> tree_count) return;
+  for (int k = line + 1; k <= buf -> tree_count; k += k & -k) {
+    buf -> wrap_tree[k] += delta;
+  }
+  buf -> total_wrapped_lines += delta;
+}
+int wrap_tree_prefix(Buffer * buf, int line) {
+  if (buf -> chop_lines) return line < buf -> count ? line : buf -> count;
+  wrap_tree_extend(buf);
+  if (line > buf -> tree_count) line = buf -> tree_count;
+  int sum = 0;
+  for (int k = line; k > 0; k -= k & -k) sum += buf -> wrap_tree[k];
+  return sum;
+}
+int wrap_tree_total(Buffer * buf) {
+  if (buf -> chop_lines) return buf -> count;
+  wrap_tree_extend(buf);
+  return buf -> total_wrapped_lines;
+}
+void wrap_tree_find(Buffer * buf, int screen_line, int * file_line, int * wrap_index) {
+  wrap_tree_extend(buf);
+  int count = buf -> chop_lines ? buf -> count : buf -> tree_count;
+  if (count == 0) {
+    * file_line = 0;
+    * wrap_index = 0;
+    return;
+  }
+  if (buf -> chop_lines) {
+    * file_line = screen_line < count ? screen_line : count - 1;
+    * wrap_index = 0;
+    return;
+  }
+  int pos = 0;
+  int remaining = screen_line;
+  int step = 1;
+  while (step * 2 <= count) step *= 2;
+  for (; step > 0; step /= 2) {
+    if (pos + step <= count && buf -> wrap_tree[pos + step] <= remaining) {
+      pos += step;
+      remaining -= buf -> wrap_tree[pos];
+    }
+  }
+  if (pos >= count) {
+    * file_line = count - 1;
+    * wrap_index = line_height(buf, buffer_line(buf, count - 1)) - 1;
+    return;
+  }
+  * file_line = pos;
+  * wrap_index = remaining;
+}